@@ -0,0 +1,384 @@
+// Stand-in for mpv that speaks its JSON IPC protocol without decoding or
+// playing anything, so the daemon, MpvController and the benchmarks run
+// deterministically on machines with no mpv and no audio device. Point the
+// daemon at it with "mpv_binary" in the config.
+//
+// Serves --input-ipc-client=fd://N (what MpvController uses) or
+// --input-ipc-server=PATH; every other option is ignored. Understands
+// observe_property, get_property, set_property, add, cycle, loadfile, stop
+// and quit; anything else is answered with an error. A loadfile plays out
+// as start-file, file-loaded, the property changes of a live stream and
+// playback-restart.
+//
+// Scripted through the environment:
+//   FAKE_MPV_STARTUP_MS=N        wait before serving IPC
+//   FAKE_MPV_REPLY_MS=N          handle each command N ms after it arrives
+//   FAKE_MPV_LOAD_MS=N           loadfile to playback-restart (default 20)
+//   FAKE_MPV_FAIL_URL=S          loads of URLs containing S end with
+//                                end-file reason "error"
+//   FAKE_MPV_METADATA_FLOOD=N[:MS]  after each playback-restart, N stream
+//                                title changes MS apart (default 0)
+//   FAKE_MPV_STALL=AFTER:FOR     paused-for-cache AFTER ms into playback,
+//                                for FOR ms
+//   FAKE_MPV_CRASH_ON=CMD[:K]    abort() on the K-th (default 1st) CMD
+//   FAKE_MPV_RECORD=PATH         append "<ms since start> <line>" for every
+//                                line received
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <string>
+#include <thread>
+#include <nlohmann/json.hpp>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+using json = nlohmann::json;
+
+int env_int(const char* name, int fallback) {
+    const char* v = getenv(name);
+    return v && *v ? std::atoi(v) : fallback;
+}
+
+std::string env_str(const char* name) {
+    const char* v = getenv(name);
+    return v ? v : "";
+}
+
+// "A:B" into a and b; b keeps its value if absent.
+void env_pair(const char* name, int& a, int& b) {
+    std::string v = env_str(name);
+    if (v.empty()) return;
+    a = std::atoi(v.c_str());
+    auto colon = v.find(':');
+    if (colon != std::string::npos) b = std::atoi(v.c_str() + colon + 1);
+}
+
+class FakeMpv {
+public:
+    explicit FakeMpv(int fd) : fd_(fd), start_(Clock::now()) {
+        reply_ms_ = env_int("FAKE_MPV_REPLY_MS", 0);
+        load_ms_ = env_int("FAKE_MPV_LOAD_MS", 20);
+        fail_url_ = env_str("FAKE_MPV_FAIL_URL");
+        flood_interval_ms_ = 0;
+        env_pair("FAKE_MPV_METADATA_FLOOD", flood_count_, flood_interval_ms_);
+        env_pair("FAKE_MPV_STALL", stall_after_ms_, stall_for_ms_);
+        std::string crash = env_str("FAKE_MPV_CRASH_ON");
+        if (!crash.empty()) {
+            auto colon = crash.find(':');
+            crash_cmd_ = crash.substr(0, colon);
+            crash_at_ = colon == std::string::npos ? 1 : std::atoi(crash.c_str() + colon + 1);
+        }
+        std::string record = env_str("FAKE_MPV_RECORD");
+        if (!record.empty()) record_ = fopen(record.c_str(), "a");
+
+        props_ = {{"mpv-version", "mpv 0.0.0-fake"},
+                  {"pause", false},
+                  {"mute", false},
+                  {"volume", 100.0},
+                  {"volume-max", 130.0},
+                  {"media-title", ""},
+                  {"metadata", nullptr},
+                  {"idle-active", true},
+                  {"core-idle", true},
+                  {"demuxer-cache-duration", 0.0},
+                  {"audio-params", nullptr},
+                  {"paused-for-cache", false},
+                  {"cache-buffering-state", 0},
+                  {"cache-secs", 1.0},
+                  {"demuxer-readahead-secs", 1.0}};
+    }
+
+    ~FakeMpv() {
+        if (record_) fclose(record_);
+    }
+
+    // Until the daemon hangs up or sends quit.
+    int run() {
+        std::string rx;
+        char buf[4096];
+        while (!quit_) {
+            int timeout = -1;
+            if (!timers_.empty()) {
+                auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    timers_.begin()->first - Clock::now()).count();
+                timeout = static_cast<int>(std::max<int64_t>(0, ms));
+            }
+            struct pollfd pfd{fd_, POLLIN, 0};
+            int n = poll(&pfd, 1, timeout);
+            if (n > 0) {
+                ssize_t got = read(fd_, buf, sizeof(buf));
+                if (got <= 0) return 0;
+                rx.append(buf, static_cast<size_t>(got));
+                size_t pos;
+                while ((pos = rx.find('\n')) != std::string::npos) {
+                    std::string line = rx.substr(0, pos);
+                    rx.erase(0, pos + 1);
+                    if (!line.empty()) receive(line);
+                }
+            }
+            auto now = Clock::now();
+            while (!timers_.empty() && timers_.begin()->first <= now && !quit_) {
+                auto fn = std::move(timers_.begin()->second);
+                timers_.erase(timers_.begin());
+                fn();
+            }
+        }
+        return 0;
+    }
+
+private:
+    void after(int ms, std::function<void()> fn) {
+        timers_.emplace(Clock::now() + std::chrono::milliseconds(ms), std::move(fn));
+    }
+
+    void send(const json& msg) {
+        std::string line = msg.dump() + "\n";
+        size_t off = 0;
+        while (off < line.size()) {
+            ssize_t n = write(fd_, line.data() + off, line.size() - off);
+            if (n <= 0) {
+                quit_ = true;
+                return;
+            }
+            off += static_cast<size_t>(n);
+        }
+    }
+
+    void event(const std::string& name, json extra = json::object()) {
+        extra["event"] = name;
+        send(extra);
+    }
+
+    // Stores a property and notifies every observer of a change.
+    void set(const std::string& name, const json& value) {
+        if (props_.contains(name) && props_[name] == value) return;
+        props_[name] = value;
+        for (auto& [id, prop] : observed_) {
+            if (prop == name)
+                event("property-change", {{"id", id}, {"name", name}, {"data", value}});
+        }
+    }
+
+    void receive(const std::string& line) {
+        if (record_) {
+            auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                Clock::now() - start_).count();
+            fprintf(record_, "%lld %s\n", static_cast<long long>(ms), line.c_str());
+            fflush(record_);
+        }
+        json msg = json::parse(line, nullptr, false);
+        if (!msg.is_object() || !msg.contains("command") || !msg["command"].is_array() ||
+            msg["command"].empty()) {
+            send({{"error", "invalid parameter"}});
+            return;
+        }
+        if (!crash_cmd_.empty() && msg["command"][0] == crash_cmd_ && ++crash_seen_ == crash_at_)
+            abort();
+        if (reply_ms_ > 0) {
+            after(reply_ms_, [this, msg] { handle(msg); });
+        } else {
+            handle(msg);
+        }
+    }
+
+    void handle(const json& msg) {
+        const json& cmd = msg["command"];
+        int64_t rid = msg.value("request_id", int64_t{0});
+        std::string name = cmd[0].is_string() ? cmd[0].get<std::string>() : "";
+        json reply = {{"request_id", rid}, {"error", "success"}, {"data", nullptr}};
+        auto arg = [&](size_t i) -> const json& {
+            static const json none;
+            return i < cmd.size() ? cmd[i] : none;
+        };
+
+        if (name == "observe_property" && arg(1).is_number_integer() && arg(2).is_string()) {
+            int id = arg(1).get<int>();
+            std::string prop = arg(2).get<std::string>();
+            observed_[id] = prop;
+            send(reply);
+            event("property-change",
+                  {{"id", id}, {"name", prop}, {"data", props_.value(prop, json())}});
+            return;
+        }
+        if (name == "get_property" && arg(1).is_string()) {
+            auto it = props_.find(arg(1).get<std::string>());
+            if (it == props_.end()) {
+                reply["error"] = "property unavailable";
+            } else {
+                reply["data"] = *it;
+            }
+        } else if (name == "set_property" && arg(1).is_string() && cmd.size() > 2) {
+            std::string prop = arg(1).get<std::string>();
+            json value = arg(2);
+            if (prop == "volume" && value.is_number())
+                value = std::clamp(value.get<double>(), 0.0, props_["volume-max"].get<double>());
+            send(reply);
+            set(prop, value);
+            return;
+        } else if (name == "add" && arg(1) == "volume" && arg(2).is_number()) {
+            double v = props_["volume"].get<double>() + arg(2).get<double>();
+            send(reply);
+            set("volume", std::clamp(v, 0.0, props_["volume-max"].get<double>()));
+            return;
+        } else if (name == "cycle" && arg(1) == "pause") {
+            send(reply);
+            set("pause", !props_["pause"].get<bool>());
+            return;
+        } else if (name == "loadfile" && arg(1).is_string()) {
+            send(reply);
+            load(arg(1).get<std::string>());
+            return;
+        } else if (name == "stop") {
+            send(reply);
+            unload("stop");
+            return;
+        } else if (name == "quit") {
+            send(reply);
+            quit_ = true;
+            return;
+        } else {
+            reply["error"] = "invalid parameter";
+        }
+        send(reply);
+    }
+
+    void unload(const char* reason) {
+        ++generation_;
+        if (!loaded_) return;
+        loaded_ = false;
+        event("end-file", {{"reason", reason}});
+        set("idle-active", true);
+        set("core-idle", true);
+        set("media-title", "");
+        set("metadata", nullptr);
+        set("demuxer-cache-duration", 0.0);
+        set("paused-for-cache", false);
+    }
+
+    void load(const std::string& url) {
+        unload("stop");
+        loaded_ = true;
+        int gen = generation_;
+        event("start-file");
+        set("idle-active", false);
+        after(load_ms_ / 2, [this, gen, url] {
+            if (gen != generation_) return;
+            if (!fail_url_.empty() && url.find(fail_url_) != std::string::npos) {
+                loaded_ = false;
+                ++generation_;
+                event("end-file", {{"reason", "error"}, {"file_error", "loading failed"}});
+                set("idle-active", true);
+                return;
+            }
+            event("file-loaded");
+            set("media-title", url);
+            set("metadata", {{"icy-name", url}});
+            set("audio-params", {{"format", "floatp"}, {"samplerate", 44100},
+                                 {"channel-count", 2}});
+        });
+        after(load_ms_, [this, gen] {
+            if (gen != generation_) return;
+            set("core-idle", false);
+            set("demuxer-cache-duration", props_["demuxer-readahead-secs"]);
+            event("playback-restart");
+            for (int i = 1; i <= flood_count_; ++i) {
+                after(i * flood_interval_ms_, [this, gen, i] {
+                    if (gen != generation_) return;
+                    std::string title = "Artist " + std::to_string(i) + " - Title " +
+                                        std::to_string(i);
+                    set("metadata", {{"icy-title", title}});
+                    set("media-title", title);
+                });
+            }
+            if (stall_for_ms_ > 0) {
+                after(stall_after_ms_, [this, gen] {
+                    if (gen != generation_) return;
+                    set("paused-for-cache", true);
+                    set("core-idle", true);
+                    set("demuxer-cache-duration", 0.0);
+                    after(stall_for_ms_, [this, gen] {
+                        if (gen != generation_) return;
+                        set("paused-for-cache", false);
+                        set("core-idle", false);
+                        set("demuxer-cache-duration", props_["demuxer-readahead-secs"]);
+                        event("playback-restart");
+                    });
+                });
+            }
+        });
+    }
+
+    int fd_;
+    Clock::time_point start_;
+    int reply_ms_ = 0;
+    int load_ms_ = 20;
+    std::string fail_url_;
+    int flood_count_ = 0;
+    int flood_interval_ms_ = 0;
+    int stall_after_ms_ = 0;
+    int stall_for_ms_ = 0;
+    std::string crash_cmd_;
+    int crash_at_ = 1;
+    int crash_seen_ = 0;
+    FILE* record_ = nullptr;
+
+    json props_;
+    std::map<int, std::string> observed_;
+    std::multimap<Clock::time_point, std::function<void()>> timers_;
+    int generation_ = 0;
+    bool loaded_ = false;
+    bool quit_ = false;
+};
+
+int listen_on(const std::string& path) {
+    int srv = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (srv < 0) return -1;
+    struct sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    unlink(path.c_str());
+    if (bind(srv, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0 ||
+        listen(srv, 1) < 0) {
+        close(srv);
+        return -1;
+    }
+    int fd = accept(srv, nullptr, nullptr);
+    close(srv);
+    unlink(path.c_str());
+    return fd;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    int fd = -1;
+    std::string server_path;
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
+        if (a.rfind("--input-ipc-client=fd://", 0) == 0)
+            fd = std::atoi(a.c_str() + std::strlen("--input-ipc-client=fd://"));
+        else if (a.rfind("--input-ipc-server=", 0) == 0)
+            server_path = a.substr(std::strlen("--input-ipc-server="));
+    }
+
+    int startup_ms = env_int("FAKE_MPV_STARTUP_MS", 0);
+    if (startup_ms > 0) std::this_thread::sleep_for(std::chrono::milliseconds(startup_ms));
+
+    if (fd < 0 && !server_path.empty()) fd = listen_on(server_path);
+    if (fd < 0) {
+        std::fprintf(stderr, "fake_mpv: need --input-ipc-client=fd://N or "
+                             "--input-ipc-server=PATH\n");
+        return 1;
+    }
+    return FakeMpv(fd).run();
+}
@@ -0,0 +1,94 @@
+// Cost of the IPC wire encodings. For a `status` exchange and a `list`
+// exchange over a generated playlist, reports per request
+//   bytes  — request + response on the wire, framing included
+//   server — decode the request, encode the response
+//   client — encode the request, decode the response
+// for JSON lines, CBOR frames and MessagePack frames.
+//
+// Usage: ipc_codec_bench [stations]
+
+#include "ipc_codec.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+using json = nlohmann::json;
+
+json status_response() {
+    return {{"status", "ok"},
+            {"data", {{"station", {{"index", 12},
+                                   {"name", "Radio Paradise Main Mix"},
+                                   {"url", "http://stream.radioparadise.com/aac-320"}}},
+                      {"playing", true},
+                      {"paused", false},
+                      {"volume", 65},
+                      {"metadata", "Pink Floyd - Shine On You Crazy Diamond"},
+                      {"station_count", 48}}}};
+}
+
+json list_response(int stations) {
+    json arr = json::array();
+    for (int i = 0; i < stations; ++i) {
+        arr.push_back({{"name", "Station " + std::to_string(i + 1) + " Classic Hits"},
+                       {"url", "http://streams.example.net:8000/live/station-" +
+                                   std::to_string(i + 1) + ".mp3"}});
+    }
+    return {{"status", "ok"}, {"data", arr}};
+}
+
+// Strips the frame header (or trailing newline) the way the receiver does.
+std::string_view body(IpcEncoding enc, const std::string& wire) {
+    if (enc == IpcEncoding::Json) return std::string_view(wire).substr(0, wire.size() - 1);
+    return std::string_view(wire).substr(IPC_FRAME_HEADER);
+}
+
+volatile size_t g_sink;
+
+void run(const char* what, const json& request, const json& response, int iterations) {
+    std::printf("%s (x %d)\n", what, iterations);
+    for (IpcEncoding enc : {IpcEncoding::Json, IpcEncoding::Cbor, IpcEncoding::MsgPack}) {
+        std::string req_wire, resp_wire;
+        ipc_encode(enc, request, req_wire);
+        ipc_encode(enc, response, resp_wire);
+
+        auto t0 = Clock::now();
+        for (int i = 0; i < iterations; ++i) {
+            json req = ipc_decode(enc, body(enc, req_wire));
+            std::string out;
+            ipc_encode(enc, response, out);
+            g_sink = g_sink + out.size() + req.size();
+        }
+        auto t1 = Clock::now();
+        for (int i = 0; i < iterations; ++i) {
+            std::string out;
+            ipc_encode(enc, request, out);
+            json resp = ipc_decode(enc, body(enc, resp_wire));
+            g_sink = g_sink + out.size() + resp.size();
+        }
+        auto t2 = Clock::now();
+
+        double server_us = std::chrono::duration<double, std::micro>(t1 - t0).count() / iterations;
+        double client_us = std::chrono::duration<double, std::micro>(t2 - t1).count() / iterations;
+        std::printf("  %-8s bytes %9zu  server %10.2f us  client %10.2f us\n",
+                    ipc_encoding_name(enc), req_wire.size() + resp_wire.size(),
+                    server_us, client_us);
+    }
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    int stations = argc > 1 ? std::atoi(argv[1]) : 10000;
+
+    run("status", {{"command", "status"}}, status_response(), 100000);
+    std::string what = "list, " + std::to_string(stations) + " stations";
+    run(what.c_str(), {{"command", "list"}}, list_response(stations),
+        std::max(10, 2000000 / std::max(stations, 1)));
+    return 0;
+}
@@ -0,0 +1,369 @@
+// Control-path load test. Runs the daemon's IPC stack — IpcServer, the
+// command registry and the real command handlers, on an epoll loop of its
+// own — against a mock player, and drives it with N concurrent client
+// sessions issuing a weighted mix of commands back to back. Reports
+// throughput, p50/p99/p999 latency per command as seen by the clients, and
+// the CPU the server thread used. Needs nothing but a writable /tmp.
+//
+// Usage: ipc_load_bench [-c clients] [-t seconds] [-n stations]
+//                       [-m status:70,list:10,volume:15,next:5]
+//                       [-e json|cbor|msgpack]
+
+#include "buffer_tuner.h"
+#include "command_registry.h"
+#include "commands.h"
+#include "config.h"
+#include "ipc_client.h"
+#include "ipc_server.h"
+#include "log.h"
+#include "mqtt_publisher.h"
+#include "player.h"
+#include "station_manager.h"
+#include "station_stats.h"
+#include "station_switcher.h"
+#include <sys/epoll.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+using json = nlohmann::json;
+
+// Answers immediately from its own state; no mpv, no audio.
+class MockPlayer : public Player {
+public:
+    const char* backend() const override { return "mock"; }
+    bool start(const std::vector<std::string>&) override {
+        ready_ = true;
+        ready_ms_ = 0;
+        props_.volume = 50;
+        return true;
+    }
+    void shutdown() override {}
+    bool play(const std::string& url) override {
+        playing_ = true;
+        props_.idle_active = false;
+        props_.pause = false;
+        props_.media_title = url;
+        return true;
+    }
+    bool stop() override {
+        playing_ = false;
+        props_.idle_active = true;
+        props_.media_title.clear();
+        return true;
+    }
+    bool toggle_pause() override {
+        props_.pause = !props_.pause;
+        return true;
+    }
+    bool set_pause(bool pause) override {
+        props_.pause = pause;
+        return true;
+    }
+    bool set_volume(int vol) override {
+        cancel_volume_steps();
+        props_.volume = vol;
+        volume_reported();
+        return true;
+    }
+    bool set_mute(bool mute, DoneCallback cb) override {
+        props_.mute = mute;
+        if (cb) cb(true);
+        return true;
+    }
+    bool set_buffering(double, double) override { return true; }
+    int fd() const override { return -1; }
+    void process_events() override {}
+
+protected:
+    bool send_volume_step(int delta) override {
+        props_.volume = std::clamp(props_.volume + delta, 0.0, props_.volume_max);
+        volume_reported();
+        return true;
+    }
+};
+
+struct MixEntry {
+    std::string command;
+    int weight;
+};
+
+struct Options {
+    int clients = 8;
+    int seconds = 5;
+    int stations = 100;
+    std::vector<MixEntry> mix = {{"status", 70}, {"list", 10}, {"volume", 15}, {"next", 5}};
+    IpcEncoding enc = IpcEncoding::Json;
+};
+
+bool parse_mix(const std::string& s, std::vector<MixEntry>& mix) {
+    mix.clear();
+    std::istringstream in(s);
+    for (std::string item; std::getline(in, item, ',');) {
+        auto colon = item.find(':');
+        if (colon == std::string::npos) return false;
+        int w = std::atoi(item.c_str() + colon + 1);
+        if (w <= 0) return false;
+        mix.push_back({item.substr(0, colon), w});
+    }
+    return !mix.empty();
+}
+
+// The daemon side: everything daemon_run() wires for IPC, minus signals,
+// the broker connection and mpv.
+class Server {
+public:
+    bool start(const std::string& dir, int stations, int max_clients) {
+        cfg_.m3u_path = dir + "/stations.m3u";
+        cfg_.adaptive_buffering = false;
+        std::ofstream m3u(cfg_.m3u_path);
+        m3u << "#EXTM3U\n";
+        for (int i = 1; i <= stations; ++i) {
+            m3u << "#EXTINF:-1,Station " << i << " Classic Hits\n"
+                << "http://streams.example.net:8000/live/station-" << i << ".mp3\n";
+        }
+        m3u.close();
+        sm_.load(cfg_.m3u_path);
+
+        PlayerFactory make = [] { return std::make_unique<MockPlayer>(); };
+        if (!sw_.start(make, {}, false)) return false;
+        register_commands(reg_, cfg_, sm_, sw_, mqtt_, stats_, tuner_);
+
+        path_ = dir + "/ipc.sock";
+        if (!ipc_.start(path_, max_clients)) return false;
+        ipc_.set_handler([this](const json& req) {
+            return reg_.dispatch(req, CommandSource::Ipc);
+        });
+
+        epfd_ = epoll_create1(EPOLL_CLOEXEC);
+        ipc_.on_watch([this](int fd, uint32_t events) {
+            struct epoll_event ev{};
+            ev.events = events;
+            ev.data.fd = fd;
+            if (events == 0) {
+                epoll_ctl(epfd_, EPOLL_CTL_DEL, fd, nullptr);
+            } else if (epoll_ctl(epfd_, EPOLL_CTL_MOD, fd, &ev) < 0 && errno == ENOENT) {
+                epoll_ctl(epfd_, EPOLL_CTL_ADD, fd, &ev);
+            }
+        });
+        struct epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.fd = ipc_.fd();
+        epoll_ctl(epfd_, EPOLL_CTL_ADD, ipc_.fd(), &ev);
+        return true;
+    }
+
+    void run(const std::atomic<bool>& stop) {
+        struct epoll_event events[32];
+        while (!stop.load(std::memory_order_relaxed)) {
+            int timeout = 50;
+            for (int t : {sw_.next_timeout_ms(), ipc_.next_timeout_ms()}) {
+                if (t >= 0 && t < timeout) timeout = t;
+            }
+            int n = epoll_wait(epfd_, events, 32, timeout);
+            for (int i = 0; i < n; ++i) ipc_.handle_fd(events[i].data.fd, events[i].events);
+            sw_.handle_timeouts();
+            ipc_.handle_timeouts();
+        }
+    }
+
+    void shutdown() {
+        ipc_.stop();
+        if (epfd_ >= 0) close(epfd_);
+        sw_.shutdown();
+    }
+
+    const std::string& path() const { return path_; }
+    json command_stats() const { return reg_.stats(); }
+
+private:
+    Config cfg_;
+    StationManager sm_;
+    StationSwitcher sw_;
+    MqttPublisher mqtt_;    // never connected: publishes are dropped
+    StationStats stats_;
+    BufferTuner tuner_;
+    CommandRegistry reg_;
+    IpcServer ipc_;
+    std::string path_;
+    int epfd_ = -1;
+};
+
+struct ClientResult {
+    std::vector<std::vector<double>> us;    // per mix entry
+    long errors = 0;
+    bool connected = false;
+};
+
+void client_loop(const Options& opt, const std::string& path, int seed,
+                 const std::atomic<bool>& go, const std::atomic<bool>& stop,
+                 ClientResult& out) {
+    out.us.resize(opt.mix.size());
+    IpcClient client;
+    client.set_encoding(opt.enc);
+    if (!client.connect(path) || !client.handshake()) return;
+    out.connected = true;
+
+    std::vector<int> weights;
+    for (auto& m : opt.mix) weights.push_back(m.weight);
+    std::mt19937 rng(static_cast<unsigned>(seed));
+    std::discrete_distribution<size_t> pick(weights.begin(), weights.end());
+    bool up = true;
+
+    while (!go.load(std::memory_order_acquire)) std::this_thread::yield();
+    while (!stop.load(std::memory_order_relaxed)) {
+        size_t k = pick(rng);
+        json req = {{"command", opt.mix[k].command}};
+        if (opt.mix[k].command == "volume") {
+            req["args"] = {{"value", up ? "up" : "down"}};
+            up = !up;
+        }
+        auto t0 = Clock::now();
+        json resp = client.request(req);
+        auto t1 = Clock::now();
+        out.us[k].push_back(std::chrono::duration<double, std::micro>(t1 - t0).count());
+        if (resp.value("status", "") != "ok") {
+            ++out.errors;
+            if (!client.is_connected()) return;
+        }
+    }
+}
+
+double percentile(std::vector<double>& v, double p) {
+    if (v.empty()) return 0;
+    size_t i = std::min(v.size() - 1, static_cast<size_t>(p * static_cast<double>(v.size())));
+    std::nth_element(v.begin(), v.begin() + static_cast<long>(i), v.end());
+    return v[i];
+}
+
+double thread_cpu_s(clockid_t clock) {
+    struct timespec ts{};
+    clock_gettime(clock, &ts);
+    return static_cast<double>(ts.tv_sec) + static_cast<double>(ts.tv_nsec) / 1e9;
+}
+
+void print_row(const char* name, std::vector<double>& v) {
+    std::printf("  %-10s %9zu  p50 %8.1f us  p99 %8.1f us  p999 %8.1f us\n", name, v.size(),
+                percentile(v, 0.50), percentile(v, 0.99), percentile(v, 0.999));
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Options opt;
+    int c;
+    while ((c = getopt(argc, argv, "c:t:n:m:e:")) != -1) {
+        switch (c) {
+        case 'c': opt.clients = std::max(1, std::atoi(optarg)); break;
+        case 't': opt.seconds = std::max(1, std::atoi(optarg)); break;
+        case 'n': opt.stations = std::max(1, std::atoi(optarg)); break;
+        case 'm':
+            if (!parse_mix(optarg, opt.mix)) {
+                std::fprintf(stderr, "bad mix: %s (want name:weight,...)\n", optarg);
+                return 1;
+            }
+            break;
+        case 'e':
+            if (!ipc_encoding_from_name(optarg, opt.enc)) {
+                std::fprintf(stderr, "unknown encoding: %s\n", optarg);
+                return 1;
+            }
+            break;
+        default:
+            std::fprintf(stderr, "usage: %s [-c clients] [-t seconds] [-n stations] "
+                                 "[-m name:weight,...] [-e json|cbor|msgpack]\n", argv[0]);
+            return 1;
+        }
+    }
+    log_init("WARN");
+
+    char tmpl[] = "/tmp/ipc_load_bench.XXXXXX";
+    const char* dir = mkdtemp(tmpl);
+    if (!dir) {
+        std::perror("mkdtemp");
+        return 1;
+    }
+
+    Server server;
+    if (!server.start(dir, opt.stations, opt.clients)) {
+        std::fprintf(stderr, "server failed to start\n");
+        return 1;
+    }
+    std::atomic<bool> go{false}, stop_clients{false}, stop_server{false};
+    std::thread server_thread([&] { server.run(stop_server); });
+    clockid_t server_clock;
+    pthread_getcpuclockid(server_thread.native_handle(), &server_clock);
+
+    std::vector<ClientResult> results(static_cast<size_t>(opt.clients));
+    std::vector<std::thread> clients;
+    for (int i = 0; i < opt.clients; ++i) {
+        clients.emplace_back(client_loop, std::cref(opt), std::cref(server.path()), i + 1,
+                             std::cref(go), std::cref(stop_clients),
+                             std::ref(results[static_cast<size_t>(i)]));
+    }
+    // Let every client connect (and finish its hello) before timing starts.
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    double cpu0 = thread_cpu_s(server_clock);
+    auto t0 = Clock::now();
+    go.store(true, std::memory_order_release);
+    std::this_thread::sleep_for(std::chrono::seconds(opt.seconds));
+    stop_clients.store(true);
+    for (auto& t : clients) t.join();
+    double wall = std::chrono::duration<double>(Clock::now() - t0).count();
+    double cpu = thread_cpu_s(server_clock) - cpu0;
+
+    stop_server.store(true);
+    server_thread.join();
+    json commands = server.command_stats();
+    server.shutdown();
+    unlink((std::string(dir) + "/stations.m3u").c_str());
+    rmdir(dir);
+
+    std::vector<std::vector<double>> per(opt.mix.size());
+    std::vector<double> all;
+    long errors = 0;
+    int connected = 0;
+    for (auto& r : results) {
+        errors += r.errors;
+        connected += r.connected;
+        for (size_t k = 0; k < r.us.size(); ++k) {
+            per[k].insert(per[k].end(), r.us[k].begin(), r.us[k].end());
+            all.insert(all.end(), r.us[k].begin(), r.us[k].end());
+        }
+    }
+
+    std::printf("%d clients (%d connected), %d stations, %s, %.1f s\n", opt.clients,
+                connected, opt.stations, ipc_encoding_name(opt.enc), wall);
+    std::printf("  requests %zu  (%.0f / s)  errors %ld\n", all.size(),
+                static_cast<double>(all.size()) / wall, errors);
+    print_row("all", all);
+    for (size_t k = 0; k < opt.mix.size(); ++k) print_row(opt.mix[k].command.c_str(), per[k]);
+    std::printf("  server CPU %.1f %% of one core, %.2f us per request\n",
+                100.0 * cpu / wall,
+                all.empty() ? 0.0 : 1e6 * cpu / static_cast<double>(all.size()));
+    std::printf("  handler time (server side):\n");
+    for (auto& m : opt.mix) {
+        auto it = commands.find(m.command);
+        if (it == commands.end() || it->value("count", 0) == 0) continue;
+        std::printf("  %-10s mean %6llu us  p50 <%6llu us  p99 <%6llu us\n", m.command.c_str(),
+                    static_cast<unsigned long long>(it->value("mean_us", 0ULL)),
+                    static_cast<unsigned long long>(it->value("p50_us", 0ULL)),
+                    static_cast<unsigned long long>(it->value("p99_us", 0ULL)));
+    }
+    return errors == 0 && connected == opt.clients ? 0 : 1;
+}
@@ -0,0 +1,164 @@
+// Replays a captured mpv IPC event log through MpvController::process_events()
+// and reports lines/sec and heap allocations per line. For comparison the same
+// bytes are also pushed through the previous framing (std::string remainder +
+// substr/erase) and a full nlohmann::json DOM parse per line.
+//
+// Capture a log from an mpv started with --input-ipc-server=/tmp/mpv.sock:
+//   socat - UNIX-CONNECT:/tmp/mpv.sock > events.log
+//
+// Usage: mpv_events_bench [events.log] [passes]
+
+#include "mpv_controller.h"
+#include "log.h"
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <new>
+#include <sstream>
+#include <string>
+
+// Counting replacement for the global allocator. GCC pairs the malloc/free
+// inside these with the new/delete at inlined call sites and complains.
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+
+static bool g_counting = false;
+static size_t g_allocs = 0;
+
+void* operator new(size_t n) {
+    if (g_counting) ++g_allocs;
+    if (void* p = std::malloc(n ? n : 1)) return p;
+    throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Result {
+    double seconds = 0;
+    size_t allocs = 0;
+};
+
+// Writes the log into the socket in fixed-size chunks (so lines straddle
+// reads the way they do on a live socket) and lets drain() consume each one.
+template <typename Drain>
+Result replay(const std::string& log, int passes, int wr, Drain drain) {
+    constexpr size_t CHUNK = 4096;
+    Result r;
+    for (int pass = 0; pass < passes; ++pass) {
+        for (size_t off = 0; off < log.size(); off += CHUNK) {
+            size_t len = std::min(CHUNK, log.size() - off);
+            if (write(wr, log.data() + off, len) != static_cast<ssize_t>(len)) {
+                std::perror("write");
+                std::exit(1);
+            }
+            auto t0 = Clock::now();
+            g_counting = true;
+            size_t before = g_allocs;
+            drain();
+            r.allocs += g_allocs - before;
+            g_counting = false;
+            r.seconds += std::chrono::duration<double>(Clock::now() - t0).count();
+        }
+    }
+    return r;
+}
+
+// The framing and parsing MpvController used before the LineBuffer rewrite.
+void legacy_drain(int fd, std::string& remainder, size_t& events) {
+    char buf[8192];
+    ssize_t n;
+    while ((n = read(fd, buf, sizeof(buf) - 1)) > 0) {
+        remainder.append(buf, static_cast<size_t>(n));
+        size_t pos;
+        while ((pos = remainder.find('\n')) != std::string::npos) {
+            std::string line = remainder.substr(0, pos);
+            remainder.erase(0, pos + 1);
+            if (line.empty()) continue;
+            try {
+                auto j = nlohmann::json::parse(line);
+                if (!j.contains("event")) continue;
+                std::string event = j["event"];
+                if (event == "property-change") {
+                    std::string name = j.value("name", "");
+                    if (!name.empty()) ++events;
+                }
+            } catch (...) {}
+        }
+    }
+}
+
+void report(const char* label, const Result& r, size_t lines) {
+    std::printf("%-28s %10.0f lines/s  %6.2f allocs/line  (%.3f s)\n",
+                label, static_cast<double>(lines) / r.seconds,
+                static_cast<double>(r.allocs) / static_cast<double>(lines),
+                r.seconds);
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    const char* path = argc > 1 ? argv[1] : "bench/data/mpv_events.log";
+    int passes = argc > 2 ? std::atoi(argv[2]) : 2000;
+    log_init("ERROR");
+
+    std::ifstream f(path);
+    if (!f) {
+        std::fprintf(stderr, "cannot open %s\n", path);
+        return 1;
+    }
+    std::stringstream ss;
+    ss << f.rdbuf();
+    std::string log = ss.str();
+    size_t lines_per_pass = 0;
+    for (char c : log) lines_per_pass += (c == '\n');
+    size_t lines = lines_per_pass * static_cast<size_t>(passes);
+
+    std::printf("replaying %s: %zu lines x %d passes\n", path, lines_per_pass, passes);
+
+    {
+        int sv[2];
+        socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+        MpvController mpv;
+        size_t meta = 0;
+        mpv.on_metadata([&](const std::string&) { ++meta; });
+        mpv.attach(sv[0]);
+
+        // Discard the observe_property commands attach() sent.
+        fcntl(sv[1], F_SETFL, O_NONBLOCK);
+        char sink[4096];
+        while (read(sv[1], sink, sizeof(sink)) > 0) {}
+        fcntl(sv[1], F_SETFL, 0);
+
+        Result r = replay(log, passes, sv[1], [&] {
+            int avail = 0;
+            while (ioctl(sv[0], FIONREAD, &avail) == 0 && avail > 0)
+                mpv.process_events();
+        });
+        report("LineBuffer + lazy scan", r, lines);
+        mpv.shutdown();
+        close(sv[1]);
+    }
+
+    {
+        int sv[2];
+        socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+        fcntl(sv[0], F_SETFL, O_NONBLOCK);
+        std::string remainder;
+        size_t events = 0;
+        Result r = replay(log, passes, sv[1], [&] {
+            legacy_drain(sv[0], remainder, events);
+        });
+        report("std::string + json DOM", r, lines);
+        close(sv[0]);
+        close(sv[1]);
+    }
+    return 0;
+}
@@ -0,0 +1,107 @@
+// Command latency of the player backends. For each backend built in, starts a
+// player and toggles mute repeatedly, measuring
+//   submit     — time spent inside set_mute(), i.e. what the event loop pays
+//   round-trip — set_mute() until mpv acknowledges through process_events()
+// and the resident memory the player added (the forked mpv counts for ipc).
+//
+// Usage: player_latency_bench [iterations] [mpv binary]
+// Needs mpv on PATH for the ipc backend (or another binary, e.g. fake_mpv)
+// and audio output set to null.
+
+#include "mpv_controller.h"
+#include "log.h"
+#include <poll.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+long rss_kib(pid_t pid) {
+    std::ifstream f(pid > 0 ? "/proc/" + std::to_string(pid) + "/status"
+                            : std::string("/proc/self/status"));
+    std::string key;
+    long value = 0;
+    while (f >> key) {
+        if (key == "VmRSS:") {
+            f >> value;
+            return value;
+        }
+        f.ignore(4096, '\n');
+    }
+    return 0;
+}
+
+double percentile(std::vector<double>& v, double p) {
+    if (v.empty()) return 0;
+    size_t i = std::min(v.size() - 1, static_cast<size_t>(p * static_cast<double>(v.size())));
+    std::nth_element(v.begin(), v.begin() + static_cast<long>(i), v.end());
+    return v[i];
+}
+
+void run(const char* name, int iterations, const std::string& binary) {
+    long rss_before = rss_kib(0);
+    std::unique_ptr<Player> player = make_player(name, binary);
+    if (!player->start({"--ao=null"})) {
+        std::printf("%-8s failed to start\n", name);
+        return;
+    }
+
+    std::vector<double> submit_us, rtt_us;
+    submit_us.reserve(static_cast<size_t>(iterations));
+    rtt_us.reserve(static_cast<size_t>(iterations));
+    int failures = 0;
+
+    for (int i = 0; i < iterations; ++i) {
+        bool done = false;
+        auto t0 = Clock::now();
+        player->set_mute(i & 1, [&](bool ok) {
+            done = true;
+            if (!ok) ++failures;
+        });
+        auto t1 = Clock::now();
+        while (!done) {
+            struct pollfd pfd{player->fd(), POLLIN, 0};
+            if (poll(&pfd, 1, 1000) <= 0) break;
+            player->process_events();
+        }
+        auto t2 = Clock::now();
+        submit_us.push_back(std::chrono::duration<double, std::micro>(t1 - t0).count());
+        rtt_us.push_back(std::chrono::duration<double, std::micro>(t2 - t0).count());
+    }
+
+    long rss = rss_kib(0) - rss_before;
+    if (auto* ipc = dynamic_cast<MpvController*>(player.get())) rss += rss_kib(ipc->pid());
+
+    std::printf("%-8s startup %4lld ms  submit p50 %6.1f us p99 %6.1f us  "
+                "round-trip p50 %7.1f us p99 %7.1f us  rss +%ld KiB%s\n",
+                name, static_cast<long long>(player->ready_ms()),
+                percentile(submit_us, 0.50), percentile(submit_us, 0.99),
+                percentile(rtt_us, 0.50), percentile(rtt_us, 0.99), rss,
+                failures ? "  (some commands failed)" : "");
+    player->shutdown();
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    int iterations = argc > 1 ? std::atoi(argv[1]) : 2000;
+    std::string binary = argc > 2 ? argv[2] : "mpv";
+    log_init("ERROR");
+
+    std::printf("set_mute x %d\n", iterations);
+    run("ipc", iterations, binary);
+#ifdef HAVE_LIBMPV
+    run("libmpv", iterations, binary);
+#else
+    std::printf("libmpv   not built (install libmpv-dev and rebuild)\n");
+#endif
+    return 0;
+}
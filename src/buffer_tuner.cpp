@@ -0,0 +1,173 @@
+#include "buffer_tuner.h"
+#include "log.h"
+#include <nlohmann/json.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+using json = nlohmann::json;
+
+namespace {
+
+// Read-ahead in seconds. New stations start in the middle; the bounds keep
+// a string of bad luck from going to extremes.
+constexpr double DEFAULT_LEVEL_S = 4;
+constexpr double MIN_LEVEL_S = 1;
+constexpr double MAX_LEVEL_S = 30;
+// cache-secs is the ceiling on how much the demuxer may hold.
+constexpr double CACHE_PER_LEVEL = 3;
+
+constexpr double STALL_GROWTH = 1.5;
+constexpr double NEAR_MISS_GROWTH = 1.25;
+constexpr double CLEAN_SHRINK = 0.8;
+// A session only says something about the link if it ran this long.
+constexpr int64_t MIN_SESSION_MS = 30000;
+constexpr int64_t CLEAN_SESSION_MS = 120000;
+constexpr int CLEAN_SESSIONS = 3;
+
+constexpr const char* STATE_FILE = "buffering.json";
+
+} // namespace
+
+void BufferTuner::load(const std::string& state_dir) {
+    path_ = state_dir.empty() ? "" : state_dir + "/" + STATE_FILE;
+    stations_.clear();
+    clock_ = 0;
+    dirty_ = false;
+    if (path_.empty()) return;
+
+    std::ifstream f(path_);
+    if (!f.good()) {
+        LOG_INFO("no learned buffering at %s", path_.c_str());
+        return;
+    }
+    try {
+        json j = json::parse(f);
+        json stations = j.value("stations", json::object());
+        for (auto& [url, v] : stations.items()) {
+            Tuning tn;
+            tn.level = std::clamp(v.value("level", DEFAULT_LEVEL_S), MIN_LEVEL_S, MAX_LEVEL_S);
+            tn.clean = v.value("clean", 0);
+            tn.last_used = v.value("last_used", uint64_t{0});
+            clock_ = std::max(clock_, tn.last_used);
+            stations_[url] = tn;
+        }
+        while (stations_.size() > MAX_STATIONS) evict();
+        LOG_INFO("loaded buffering for %zu stations from %s", stations_.size(),
+                 path_.c_str());
+    } catch (const json::exception& e) {
+        LOG_WARN("ignoring %s: %s", path_.c_str(), e.what());
+    }
+}
+
+double BufferTuner::level(const std::string& url) const {
+    auto it = stations_.find(url);
+    return it == stations_.end() ? DEFAULT_LEVEL_S : it->second.level;
+}
+
+void BufferTuner::apply(Player& player, const std::string& url) const {
+    double lvl = level(url);
+    LOG_DEBUG("buffering for %s: %.1f s", url.c_str(), lvl);
+    player.set_buffering(lvl * CACHE_PER_LEVEL, lvl);
+}
+
+BufferTuner::Tuning& BufferTuner::touch(const std::string& url) {
+    auto [it, inserted] = stations_.try_emplace(url);
+    Tuning& tn = it->second;
+    tn.last_used = ++clock_;
+    dirty_ = true;
+    if (inserted) {
+        tn.level = DEFAULT_LEVEL_S;
+        if (stations_.size() > MAX_STATIONS) evict();
+    }
+    return tn;
+}
+
+void BufferTuner::evict() {
+    auto lru = std::min_element(stations_.begin(), stations_.end(),
+                                [](const auto& a, const auto& b) {
+        return a.second.last_used < b.second.last_used;
+    });
+    LOG_DEBUG("forgetting buffering for %s", lru->first.c_str());
+    stations_.erase(lru);
+}
+
+void BufferTuner::observe(TelemetryEvent ev, const PlaybackTelemetry& t) {
+    if (t.url.empty()) return;
+
+    if (ev == TelemetryEvent::Stall) {
+        Tuning& tn = touch(t.url);
+        tn.clean = 0;
+        set_level(t.url, tn, tn.level * STALL_GROWTH, "stall");
+        // A bad link stalls in bursts; the rest is written at the end.
+        if (Clock::now() - last_save_ >= SAVE_INTERVAL) flush();
+        return;
+    }
+    if (ev != TelemetryEvent::End) return;
+    if (t.played_ms >= MIN_SESSION_MS) learn(t.url, touch(t.url), t);
+    flush();
+}
+
+void BufferTuner::learn(const std::string& url, Tuning& tn,
+                        const PlaybackTelemetry& t) {
+    if (t.stalls > 0) {
+        // Already grown per stall; a session ending mid-stall counts too
+        // but was never reported as a Stall.
+        tn.clean = 0;
+        return;
+    }
+    if (t.min_cache_s >= 0 && t.min_cache_s < tn.level * 0.25) {
+        tn.clean = 0;
+        set_level(url, tn, tn.level * NEAR_MISS_GROWTH, "cache nearly ran dry");
+        return;
+    }
+    if (t.played_ms >= CLEAN_SESSION_MS &&
+        (t.min_cache_s < 0 || t.min_cache_s >= tn.level * 0.5) &&
+        ++tn.clean >= CLEAN_SESSIONS) {
+        tn.clean = 0;
+        set_level(url, tn, tn.level * CLEAN_SHRINK, "stable");
+    }
+}
+
+void BufferTuner::set_level(const std::string& url, Tuning& tn, double level,
+                            const char* why) {
+    level = std::clamp(level, MIN_LEVEL_S, MAX_LEVEL_S);
+    if (level != tn.level) {
+        LOG_INFO("buffering for %s: %.1f → %.1f s (%s)", url.c_str(), tn.level,
+                 level, why);
+        tn.level = level;
+    }
+}
+
+void BufferTuner::flush() {
+    if (dirty_) save();
+}
+
+void BufferTuner::save() {
+    dirty_ = false;
+    last_save_ = Clock::now();
+    if (path_.empty()) return;
+    json stations = json::object();
+    for (auto& [url, tn] : stations_) {
+        stations[url] = {{"level", tn.level}, {"clean", tn.clean},
+                         {"last_used", tn.last_used}};
+    }
+
+    // Write-then-rename so a crash never leaves a truncated file behind.
+    std::string tmp = path_ + ".tmp";
+    {
+        std::ofstream f(tmp, std::ios::trunc);
+        if (!f.good()) {
+            LOG_WARN("cannot write %s: %s", tmp.c_str(), strerror(errno));
+            return;
+        }
+        f << json({{"stations", stations}}).dump(2) << "\n";
+        if (!f.good()) {
+            LOG_WARN("cannot write %s", tmp.c_str());
+            return;
+        }
+    }
+    if (std::rename(tmp.c_str(), path_.c_str()) != 0)
+        LOG_WARN("rename %s: %s", path_.c_str(), strerror(errno));
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "player.h"
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+// Learns a network buffer size per station from how its streams behave and
+// applies it (cache-secs / demuxer-readahead-secs) before each load. Stations
+// that stall, or whose cache runs nearly dry, get a bigger buffer; stations
+// that play cleanly for a while get a smaller one so they start faster.
+// Learned levels are kept in <state_dir>/buffering.json, for at most
+// MAX_STATIONS stations (the least recently played one is forgotten).
+class BufferTuner {
+public:
+    static constexpr size_t MAX_STATIONS = 64;
+
+    // Loads previously learned levels; a missing file is not an error.
+    void load(const std::string& state_dir);
+    // Sets the buffering mpv should use for url's next load.
+    void apply(Player& player, const std::string& url) const;
+    // Learns from the audible instance's telemetry.
+    void observe(TelemetryEvent ev, const PlaybackTelemetry& t);
+    // Current level for url in seconds of read-ahead.
+    double level(const std::string& url) const;
+    // Writes unsaved levels. observe() writes when a session ends and at
+    // most every SAVE_INTERVAL while stalls keep coming.
+    void flush();
+
+private:
+    using Clock = std::chrono::steady_clock;
+    static constexpr Clock::duration SAVE_INTERVAL = std::chrono::seconds(60);
+
+    struct Tuning {
+        double level = 0;
+        int clean = 0;     // consecutive long sessions without trouble
+        uint64_t last_used = 0;
+    };
+
+    Tuning& touch(const std::string& url);
+    void evict();
+    void learn(const std::string& url, Tuning& tn, const PlaybackTelemetry& t);
+    void set_level(const std::string& url, Tuning& tn, double level, const char* why);
+    void save();
+
+    std::string path_;
+    std::unordered_map<std::string, Tuning> stations_;
+    uint64_t clock_ = 0;
+    bool dirty_ = false;
+    Clock::time_point last_save_{};
+};
@@ -1,14 +1,23 @@
 #include "cli.h"
+#include "config.h"
 #include "ipc_client.h"
+#include "status_page.h"
 #include "log.h"
 #include <nlohmann/json.hpp>
-#include <iostream>
+#include <unistd.h>
+#include <chrono>
 #include <cstring>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <vector>
 
 using json = nlohmann::json;
 
 static json ipc(const std::string& socket_path, const json& request) {
     IpcClient client;
+    client.set_encoding(IpcEncoding::Cbor);
     return client.send(socket_path, request);
 }
 
@@ -29,85 +38,218 @@ static void print_json(const json& j) {
     }
 }
 
-static int cmd_play(const std::string& sock, int argc, char* argv[]) {
-    json req = {{"command", "play"}};
-    if (argc > 1) {
-        req["args"] = {{"station", std::atoi(argv[1])}};
+// The request for a command line; false (with a message) if it is not a
+// daemon command. status is sent over IPC here; the status page path is
+// cmd_status().
+static bool make_request(const std::vector<std::string>& words, json& req,
+                         std::string& err) {
+    if (words.empty()) {
+        err = "empty command";
+        return false;
     }
-    print_json(ipc(sock, req));
-    return 0;
+    const std::string& cmd = words[0];
+    req = {{"command", cmd}};
+    if (cmd == "play") {
+        if (words.size() > 1) req["args"] = {{"station", std::atoi(words[1].c_str())}};
+        return true;
+    }
+    if (cmd == "volume") {
+        if (words.size() > 1) req["args"] = {{"value", words[1]}};
+        return true;
+    }
+    if (cmd == "stop" || cmd == "toggle" || cmd == "next" || cmd == "prev" ||
+        cmd == "list" || cmd == "status" || cmd == "stats" || cmd == "commands" ||
+        cmd == "reload") {
+        return true;
+    }
+    err = "Unknown command: " + cmd;
+    return false;
 }
 
-static int cmd_stop(const std::string& sock) {
-    print_json(ipc(sock, {{"command", "stop"}}));
-    return 0;
+// Prints an answer to make_request()'s request; false if it is an error.
+static bool print_response(const json& req, const json& resp) {
+    if (req.value("command", "") == "list" && resp.contains("data") &&
+        resp["data"].is_array()) {
+        auto& arr = resp["data"];
+        for (size_t i = 0; i < arr.size(); ++i) {
+            auto& s = arr[i];
+            std::cout << (i + 1) << ". " << s.value("name", "?")
+                      << "  [" << s.value("url", "") << "]\n";
+        }
+        return true;
+    }
+    print_json(resp);
+    return resp.value("status", "") == "ok";
 }
 
-static int cmd_toggle(const std::string& sock) {
-    print_json(ipc(sock, {{"command", "toggle"}}));
+static int cmd_simple(const std::string& sock, int argc, char* argv[]) {
+    json req;
+    std::string err;
+    if (!make_request(std::vector<std::string>(argv, argv + argc), req, err)) {
+        std::cerr << err << "\n";
+        return 1;
+    }
+    print_response(req, ipc(sock, req));
     return 0;
 }
 
-static int cmd_next(const std::string& sock) {
-    print_json(ipc(sock, {{"command", "next"}}));
+// Served from the daemon's status page when it is there; IPC otherwise.
+// --wait prints the next change instead of the current state.
+static int cmd_status(const std::string& sock, int argc, char* argv[]) {
+    bool wait = argc > 1 && std::strcmp(argv[1], "--wait") == 0;
+    StatusPage page;
+    StatusSnapshot st;
+    if (page.open(DEFAULT_STATUS_PAGE_PATH) && page.read(st)) {
+        if (wait && !(page.wait_change(st.version, -1) && page.read(st))) {
+            std::cerr << "Error: daemon went away\n";
+            return 1;
+        }
+        std::cout << st.to_json().dump(2) << "\n";
+        return 0;
+    }
+    if (wait) {
+        std::cerr << "Error: no status page (is the daemon running?)\n";
+        return 1;
+    }
+    print_json(ipc(sock, {{"command", "status"}}));
     return 0;
 }
 
-static int cmd_prev(const std::string& sock) {
-    print_json(ipc(sock, {{"command", "prev"}}));
-    return 0;
-}
+// Prints the current state, then one JSON line per change until the daemon
+// goes away.
+static int cmd_watch(const std::string& sock) {
+    IpcClient client;
+    client.set_encoding(IpcEncoding::Cbor);
+    if (!client.connect(sock)) {
+        std::cerr << "Error: cannot connect to daemon (is it running?)\n";
+        return 1;
+    }
+    json resp = client.request({{"command", "watch"}});
+    if (resp.value("status", "") != "ok") {
+        print_json(resp);
+        return 1;
+    }
+    std::cout << json({{"event", "state"}, {"data", resp["data"]}}).dump() << std::endl;
 
-static int cmd_volume(const std::string& sock, int argc, char* argv[]) {
-    if (argc < 2) {
-        print_json(ipc(sock, {{"command", "volume"}}));
-        return 0;
+    client.set_timeout(0);
+    while (true) {
+        json ev = client.receive();
+        if (!ev.contains("event")) {
+            print_json(ev);
+            return 1;
+        }
+        std::cout << ev.dump() << std::endl;
     }
-    std::string val = argv[1];
-    json req = {{"command", "volume"}, {"args", {{"value", val}}}};
-    print_json(ipc(sock, req));
-    return 0;
 }
 
-static int cmd_list(const std::string& sock) {
-    auto resp = ipc(sock, {{"command", "list"}});
-    if (resp.contains("data") && resp["data"].is_array()) {
-        auto& arr = resp["data"];
-        for (size_t i = 0; i < arr.size(); ++i) {
-            auto& s = arr[i];
-            std::cout << (i + 1) << ". " << s.value("name", "?")
-                      << "  [" << s.value("url", "") << "]\n";
+// One connection for many commands, in CBOR if the daemon takes it.
+static bool open_session(IpcClient& client, const std::string& sock) {
+    client.set_encoding(IpcEncoding::Cbor);
+    if (client.connect(sock) && client.handshake()) return true;
+    client.set_encoding(IpcEncoding::Json);
+    return client.connect(sock);
+}
+
+// Words of a shell/batch line; everything after '#' is a comment.
+static std::vector<std::string> split_words(const std::string& line) {
+    std::istringstream in(line.substr(0, line.find('#')));
+    std::vector<std::string> words;
+    for (std::string w; in >> w;) words.push_back(w);
+    return words;
+}
+
+// Reads commands one per line and answers each over one connection.
+// Interactively every command waits for its answer. Otherwise commands are
+// pipelined, up to BATCH_WINDOW ahead of their answers, which still print in
+// order. Fails if any command did.
+static int run_session(const std::string& sock, std::istream& in, bool interactive) {
+    constexpr size_t BATCH_WINDOW = 64;
+    // The daemon drops sessions idle for 60 s; a shell reconnects before then.
+    constexpr auto RECONNECT_IDLE = std::chrono::seconds(50);
+
+    IpcClient client;
+    if (!open_session(client, sock)) {
+        std::cerr << "Error: cannot connect to daemon (is it running?)\n";
+        return 1;
+    }
+    auto last_answer = std::chrono::steady_clock::now();
+    std::deque<json> in_flight;
+    bool failed = false;
+
+    auto collect = [&]() {
+        json req = std::move(in_flight.front());
+        in_flight.pop_front();
+        json resp = client.receive();
+        last_answer = std::chrono::steady_clock::now();
+        if (!print_response(req, resp)) failed = true;
+        return client.is_connected();
+    };
+
+    std::string line;
+    while (true) {
+        if (interactive) std::cout << "rpiradio> " << std::flush;
+        if (!std::getline(in, line)) break;
+        auto words = split_words(line);
+        if (words.empty()) continue;
+        if (words[0] == "quit" || words[0] == "exit") break;
+
+        json req;
+        std::string err;
+        if (!make_request(words, req, err)) {
+            while (!in_flight.empty()) {
+                if (!collect()) return 1;
+            }
+            std::cout << std::flush;
+            std::cerr << err << "\n";
+            failed = true;
+            continue;
+        }
+        if (interactive && std::chrono::steady_clock::now() - last_answer > RECONNECT_IDLE &&
+            !open_session(client, sock)) {
+            std::cerr << "Error: cannot connect to daemon (is it running?)\n";
+            return 1;
+        }
+        if (!client.post(req)) {
+            std::cerr << "Error: cannot send to daemon\n";
+            return 1;
+        }
+        in_flight.push_back(std::move(req));
+        if (interactive || in_flight.size() >= BATCH_WINDOW) {
+            if (!collect()) return 1;
         }
-    } else {
-        print_json(resp);
     }
-    return 0;
+    while (!in_flight.empty()) {
+        if (!collect()) return 1;
+    }
+    if (interactive) std::cout << "\n";
+    return failed ? 1 : 0;
 }
 
-static int cmd_status(const std::string& sock) {
-    print_json(ipc(sock, {{"command", "status"}}));
-    return 0;
+static int cmd_shell(const std::string& sock) {
+    return run_session(sock, std::cin, isatty(STDIN_FILENO));
 }
 
-static int cmd_reload(const std::string& sock) {
-    print_json(ipc(sock, {{"command", "reload"}}));
-    return 0;
+static int cmd_batch(const std::string& sock, int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cerr << "Usage: batch <file|->\n";
+        return 1;
+    }
+    if (std::strcmp(argv[1], "-") == 0) return run_session(sock, std::cin, false);
+    std::ifstream file(argv[1]);
+    if (!file) {
+        std::cerr << "Error: cannot open " << argv[1] << "\n";
+        return 1;
+    }
+    return run_session(sock, file, false);
 }
 
 int cli_dispatch(const std::string& socket_path, int argc, char* argv[]) {
     if (argc < 1) return 1;
     std::string cmd = argv[0];
 
-    if (cmd == "play")    return cmd_play(socket_path, argc, argv);
-    if (cmd == "stop")    return cmd_stop(socket_path);
-    if (cmd == "toggle")  return cmd_toggle(socket_path);
-    if (cmd == "next")    return cmd_next(socket_path);
-    if (cmd == "prev")    return cmd_prev(socket_path);
-    if (cmd == "volume")  return cmd_volume(socket_path, argc, argv);
-    if (cmd == "list")    return cmd_list(socket_path);
-    if (cmd == "status")  return cmd_status(socket_path);
-    if (cmd == "reload")  return cmd_reload(socket_path);
-
-    std::cerr << "Unknown command: " << cmd << "\n";
-    return 1;
+    if (cmd == "status")  return cmd_status(socket_path, argc, argv);
+    if (cmd == "watch")   return cmd_watch(socket_path);
+    if (cmd == "shell")   return cmd_shell(socket_path);
+    if (cmd == "batch")   return cmd_batch(socket_path, argc, argv);
+    return cmd_simple(socket_path, argc, argv);
 }
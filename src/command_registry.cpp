@@ -0,0 +1,150 @@
+#include "command_registry.h"
+#include <algorithm>
+#include <chrono>
+
+using json = nlohmann::json;
+
+static const char* type_name(ArgType t) {
+    switch (t) {
+    case ArgType::Int:         return "an integer";
+    case ArgType::Bool:        return "a boolean";
+    case ArgType::String:      return "a string";
+    case ArgType::IntOrString: return "an integer or a string";
+    }
+    return "?";
+}
+
+static bool type_ok(ArgType t, const json& v) {
+    switch (t) {
+    case ArgType::Int:         return v.is_number_integer();
+    case ArgType::Bool:        return v.is_boolean();
+    case ArgType::String:      return v.is_string();
+    case ArgType::IntOrString: return v.is_number_integer() || v.is_string();
+    }
+    return false;
+}
+
+static const char* source_name(size_t i) {
+    static const char* names[] = {"ipc", "mqtt"};
+    return names[i];
+}
+
+void CommandRegistry::add(const std::string& name, std::vector<ArgSpec> args,
+                          Handler handler) {
+    Entry& e = commands_[name];
+    e.args = std::move(args);
+    e.handler = std::move(handler);
+}
+
+bool CommandRegistry::validate(const Entry& e, const json& args, std::string& why) {
+    if (!args.is_object()) {
+        why = "args must be an object";
+        return false;
+    }
+    for (auto& spec : e.args) {
+        auto it = args.find(spec.name);
+        if (it == args.end()) {
+            if (spec.required) {
+                why = "missing argument: " + spec.name;
+                return false;
+            }
+            continue;
+        }
+        if (!type_ok(spec.type, *it)) {
+            why = "argument " + spec.name + " must be " + type_name(spec.type);
+            return false;
+        }
+    }
+    for (auto& [key, value] : args.items()) {
+        bool known = std::any_of(e.args.begin(), e.args.end(),
+                                 [&](const ArgSpec& s) { return s.name == key; });
+        if (!known) {
+            why = "unknown argument: " + key;
+            return false;
+        }
+    }
+    return true;
+}
+
+json CommandRegistry::dispatch(const json& request, CommandSource source) {
+    auto name = request.find("command");
+    if (name == request.end() || !name->is_string())
+        return {{"status", "error"}, {"message", "missing command"}};
+    auto it = commands_.find(name->get_ref<const std::string&>());
+    if (it == commands_.end())
+        return {{"status", "error"},
+                {"message", "unknown command: " + name->get<std::string>()}};
+    Entry& e = it->second;
+
+    auto start = std::chrono::steady_clock::now();
+    static const json no_args = json::object();
+    auto a = request.find("args");
+    const json& args = a == request.end() ? no_args : *a;
+
+    json response;
+    std::string why;
+    if (!validate(e, args, why)) {
+        response = {{"status", "error"}, {"message", why}};
+    } else {
+        response = e.handler(args);
+    }
+
+    auto us = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    bool ok = response.is_object() && response.value("status", "") == "ok";
+    record(e, source, static_cast<uint64_t>(us), ok);
+    return response;
+}
+
+void CommandRegistry::record(Entry& e, CommandSource source, uint64_t us, bool ok) {
+    ++e.calls[static_cast<size_t>(source)];
+    if (!ok) ++e.errors;
+    e.total_us += us;
+    e.max_us = std::max(e.max_us, us);
+    size_t b = 0;
+    while (b + 1 < BUCKETS && us >= (uint64_t{1} << b)) ++b;
+    ++e.histogram[b];
+}
+
+json CommandRegistry::stats() const {
+    json out = json::object();
+    for (auto& [name, e] : commands_) {
+        uint64_t count = 0;
+        json calls = json::object();
+        for (size_t s = 0; s < e.calls.size(); ++s) {
+            if (e.calls[s]) calls[source_name(s)] = e.calls[s];
+            count += e.calls[s];
+        }
+        if (count == 0) {
+            out[name] = {{"count", 0}};
+            continue;
+        }
+
+        // Percentiles resolve to a bucket's upper bound, or the slowest call.
+        auto pct = [&](double p) -> uint64_t {
+            auto want = static_cast<uint64_t>(p * static_cast<double>(count));
+            uint64_t seen = 0;
+            for (size_t b = 0; b < BUCKETS; ++b) {
+                seen += e.histogram[b];
+                if (seen > want) return std::min(uint64_t{1} << b, e.max_us);
+            }
+            return e.max_us;
+        };
+        json hist = json::object();
+        for (size_t b = 0; b < BUCKETS; ++b) {
+            if (!e.histogram[b]) continue;
+            std::string key = b + 1 < BUCKETS ? "<" + std::to_string(uint64_t{1} << b)
+                                              : ">=" + std::to_string(uint64_t{1} << (b - 1));
+            hist[key] = e.histogram[b];
+        }
+        out[name] = {{"count", count},
+                     {"calls", calls},
+                     {"errors", e.errors},
+                     {"mean_us", e.total_us / count},
+                     {"p50_us", pct(0.50)},
+                     {"p99_us", pct(0.99)},
+                     {"max_us", e.max_us},
+                     {"histogram_us", hist}};
+    }
+    return out;
+}
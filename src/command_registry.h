@@ -0,0 +1,69 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+enum class ArgType {
+    Int,
+    Bool,
+    String,
+    IntOrString,
+};
+
+struct ArgSpec {
+    std::string name;
+    ArgType type;
+    bool required = false;
+};
+
+// Where a command came from; counted separately per command.
+enum class CommandSource {
+    Ipc,
+    Mqtt,
+};
+
+// Single dispatcher for daemon commands, whatever their source. Handlers are
+// looked up by name in a hash table; their arguments are checked against the
+// schema given at registration before the handler runs, so handlers only
+// read them. Every dispatch is counted and timed per command.
+class CommandRegistry {
+public:
+    // Receives the validated args object; returns the full response
+    // ({"status": "ok", ...} or {"status": "error", "message": ...}).
+    using Handler = std::function<nlohmann::json(const nlohmann::json& args)>;
+
+    void add(const std::string& name, std::vector<ArgSpec> args, Handler handler);
+    bool has(const std::string& name) const { return commands_.count(name) != 0; }
+
+    // Runs {"command": name, "args": {...}}.
+    nlohmann::json dispatch(const nlohmann::json& request, CommandSource source);
+
+    // Per command: calls by source, errors, and a latency histogram with
+    // percentiles (bucket upper bounds).
+    nlohmann::json stats() const;
+
+private:
+    // Bucket i counts calls that took < 2^i microseconds; the last one
+    // takes everything slower.
+    static constexpr size_t BUCKETS = 24;
+
+    struct Entry {
+        std::vector<ArgSpec> args;
+        Handler handler;
+        std::array<uint64_t, 2> calls{};    // by CommandSource
+        uint64_t errors = 0;
+        uint64_t total_us = 0;
+        uint64_t max_us = 0;
+        std::array<uint64_t, BUCKETS> histogram{};
+    };
+
+    static bool validate(const Entry& e, const nlohmann::json& args, std::string& why);
+    static void record(Entry& e, CommandSource source, uint64_t us, bool ok);
+
+    std::unordered_map<std::string, Entry> commands_;
+};
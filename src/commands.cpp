@@ -0,0 +1,202 @@
+#include "commands.h"
+#include "log.h"
+#include "station_manager.h"
+#include "station_switcher.h"
+#include "station_stats.h"
+#include "buffer_tuner.h"
+#include "mqtt_publisher.h"
+#include <cstdlib>
+
+using json = nlohmann::json;
+
+StatusSnapshot snapshot(Player& mpv, StationManager& sm) {
+    StatusSnapshot s;
+    if (auto* st = sm.current()) {
+        s.station_index = sm.current_index() + 1;
+        s.station_name = st->name;
+        s.station_url = st->url;
+    }
+    s.station_count = static_cast<int>(sm.count());
+    s.playing = mpv.is_playing();
+    s.paused = mpv.is_paused();
+    s.volume = mpv.get_volume();
+    s.metadata = mpv.get_metadata();
+    return s;
+}
+
+void publish_full_state(MqttPublisher& mqtt, Player& mpv, StationManager& sm) {
+    mqtt.publish_state(snapshot(mpv, sm).to_json());
+}
+
+static void publish_station(MqttPublisher& mqtt, StationManager& sm) {
+    auto* st = sm.current();
+    if (!st) return;
+    mqtt.publish_station(json({{"index", sm.current_index() + 1},
+                               {"name", st->name},
+                               {"url", st->url}}).dump());
+}
+
+void publish_everything(MqttPublisher& mqtt, Player& mpv, StationManager& sm) {
+    publish_station(mqtt, sm);
+    publish_full_state(mqtt, mpv, sm);
+    mqtt.publish_metadata(mpv.get_metadata());
+    int volume = mpv.get_volume();
+    if (volume >= 0) mqtt.publish_volume(volume);
+}
+
+void prepare_standby(StationSwitcher& sw, StationManager& sm, int direction) {
+    if (!sw.has_standby()) return;
+    auto* next = sm.peek(direction);
+    if (!next || next == sm.current() || !sw.active().is_playing()) {
+        sw.prepare("");
+        return;
+    }
+    sw.prepare(next->url);
+}
+
+static void do_play_station(StationSwitcher& sw, StationManager& sm,
+                             MqttPublisher& mqtt, int index = -1,
+                             int direction = 1) {
+    if (index >= 0) sm.select(index);
+    auto* st = sm.current();
+    if (!st) return;
+    sw.play(st->url);
+    prepare_standby(sw, sm, direction);
+    publish_station(mqtt, sm);
+    publish_full_state(mqtt, sw.active(), sm);
+}
+
+static json ok(json data = nullptr) {
+    json r = {{"status", "ok"}};
+    if (!data.is_null()) r["data"] = std::move(data);
+    return r;
+}
+
+static json error(const std::string& message) {
+    return {{"status", "error"}, {"message", message}};
+}
+
+void register_commands(CommandRegistry& reg, Config& cfg,
+                       StationManager& sm, StationSwitcher& sw,
+                       MqttPublisher& mqtt, const StationStats& stats,
+                       const BufferTuner& tuner) {
+    reg.add("play", {{"station", ArgType::Int}}, [&](const json& args) {
+        int station = args.value("station", 0);
+        if (station > 0) {
+            do_play_station(sw, sm, mqtt, station - 1);
+        } else {
+            if (auto* st = sm.current()) {
+                sw.play(st->url);
+                prepare_standby(sw, sm);
+            }
+            publish_full_state(mqtt, sw.active(), sm);
+        }
+        return ok();
+    });
+
+    reg.add("stop", {}, [&](const json&) {
+        sw.stop();
+        publish_full_state(mqtt, sw.active(), sm);
+        return ok();
+    });
+
+    reg.add("toggle", {}, [&](const json&) {
+        Player& mpv = sw.active();
+        if (!mpv.is_playing() && !mpv.is_paused()) {
+            // Nothing loaded — start playing
+            if (!sm.current() && sm.count() > 0) {
+                sm.select(0);
+            }
+            if (!sm.current()) return error("no stations available");
+            do_play_station(sw, sm, mqtt);
+        } else {
+            // The new state is published from mpv's pause event.
+            mpv.toggle_pause();
+        }
+        return ok();
+    });
+
+    reg.add("next", {}, [&](const json&) {
+        sm.next();
+        do_play_station(sw, sm, mqtt, -1, 1);
+        return ok();
+    });
+
+    reg.add("prev", {}, [&](const json&) {
+        sm.prev();
+        do_play_station(sw, sm, mqtt, -1, -1);
+        return ok();
+    });
+
+    // value: "up", "down", a level as a string or a number; none reads it.
+    // The MQTT volume topic follows mpv's settled value (on_volume), so a
+    // burst of steps publishes once.
+    reg.add("volume", {{"value", ArgType::IntOrString}}, [&](const json& args) {
+        Player& mpv = sw.active();
+        auto it = args.find("value");
+        if (it == args.end() || (it->is_string() && it->get_ref<const std::string&>().empty()))
+            return ok(mpv.get_volume());
+        if (it->is_number_integer()) {
+            mpv.set_volume(it->get<int>());
+        } else if (*it == "up") {
+            mpv.adjust_volume(5);
+        } else if (*it == "down") {
+            mpv.adjust_volume(-5);
+        } else {
+            mpv.set_volume(std::atoi(it->get_ref<const std::string&>().c_str()));
+        }
+        return ok(mpv.get_volume());
+    });
+
+    reg.add("list", {}, [&](const json&) {
+        json arr = json::array();
+        for (auto& s : sm.list()) {
+            arr.push_back({{"name", s.name}, {"url", s.url}});
+        }
+        return ok(std::move(arr));
+    });
+
+    auto status = [&](const json&) { return ok(snapshot(sw.active(), sm).to_json()); };
+    reg.add("status", {}, status);
+    // Answers with the current state; IpcServer then streams changes.
+    reg.add("watch", {}, status);
+
+    reg.add("stats", {}, [&](const json&) {
+        Player& mpv = sw.active();
+        PlaybackTelemetry live = mpv.telemetry();
+        json stations = stats.to_json(live);
+        for (auto& st : stations) {
+            for (auto& s : sm.list()) {
+                if (s.url == st["url"]) {
+                    st["name"] = s.name;
+                    break;
+                }
+            }
+            if (cfg.adaptive_buffering)
+                st["buffer_s"] = tuner.level(st["url"].get<std::string>());
+        }
+        json current = nullptr;
+        if (!live.url.empty()) {
+            current = {{"url", live.url},
+                       {"first_audio_ms", live.first_audio_ms},
+                       {"stalls", live.stalls},
+                       {"stalled_ms", live.stalled_ms},
+                       {"played_s", live.played_ms / 1000},
+                       {"buffering", mpv.properties().paused_for_cache},
+                       {"cache_buffering", mpv.properties().cache_buffering},
+                       {"cache_duration", mpv.cache_duration()}};
+        }
+        return ok({{"current", current}, {"stations", stations}});
+    });
+
+    reg.add("commands", {}, [&reg](const json&) { return ok(reg.stats()); });
+
+    reg.add("reload", {}, [&](const json&) {
+        cfg = config_load();
+        log_init(cfg.log_level);
+        sm.load(cfg.m3u_path);
+        prepare_standby(sw, sm);
+        LOG_INFO("config reloaded");
+        return ok();
+    });
+}
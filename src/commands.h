@@ -0,0 +1,29 @@
+#pragma once
+
+#include "command_registry.h"
+#include "config.h"
+#include "status_page.h"
+
+class Player;
+class StationManager;
+class StationSwitcher;
+class StationStats;
+class BufferTuner;
+class MqttPublisher;
+
+// The state `status` reports, the status page holds and MQTT publishes.
+StatusSnapshot snapshot(Player& mpv, StationManager& sm);
+void publish_full_state(MqttPublisher& mqtt, Player& mpv, StationManager& sm);
+// Every topic, as after a (re)connect to the broker.
+void publish_everything(MqttPublisher& mqtt, Player& mpv, StationManager& sm);
+
+// Points the standby instance (if any) at the station the listener is most
+// likely to pick next: the neighbour in the direction they last moved.
+void prepare_standby(StationSwitcher& sw, StationManager& sm, int direction = 1);
+
+// Every command the daemon understands, whichever path it arrives on. The
+// handlers keep references to everything passed in.
+void register_commands(CommandRegistry& reg, Config& cfg,
+                       StationManager& sm, StationSwitcher& sw,
+                       MqttPublisher& mqtt, const StationStats& stats,
+                       const BufferTuner& tuner);
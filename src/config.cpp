@@ -12,10 +12,18 @@ nlohmann::json config_to_json(const Config& cfg) {
     j["mqtt_host"] = cfg.mqtt_host;
     j["mqtt_port"] = cfg.mqtt_port;
     j["topic_prefix"] = cfg.topic_prefix;
+    j["mqtt_min_interval_ms"] = cfg.mqtt_min_interval_ms;
+    j["mqtt_state_interval_ms"] = cfg.mqtt_state_interval_ms;
     j["log_level"] = cfg.log_level;
+    j["player_backend"] = cfg.player_backend;
+    j["mpv_binary"] = cfg.mpv_binary;
     j["mpv_extra_args"] = cfg.mpv_extra_args;
+    j["zap_standby"] = cfg.zap_standby;
+    j["adaptive_buffering"] = cfg.adaptive_buffering;
+    j["state_dir"] = cfg.state_dir;
     j["ipc_socket_path"] = cfg.ipc_socket_path;
-    j["mpv_socket_path"] = cfg.mpv_socket_path;
+    j["ipc_max_clients"] = cfg.ipc_max_clients;
+    j["status_page_path"] = cfg.status_page_path;
     return j;
 }
 
@@ -25,10 +33,30 @@ Config config_from_json(const nlohmann::json& j) {
     if (j.contains("mqtt_host"))      cfg.mqtt_host       = j["mqtt_host"].get<std::string>();
     if (j.contains("mqtt_port"))      cfg.mqtt_port       = j["mqtt_port"].get<int>();
     if (j.contains("topic_prefix"))   cfg.topic_prefix    = j["topic_prefix"].get<std::string>();
+    if (j.contains("mqtt_min_interval_ms")) cfg.mqtt_min_interval_ms = j["mqtt_min_interval_ms"].get<int>();
+    if (j.contains("mqtt_state_interval_ms")) cfg.mqtt_state_interval_ms = j["mqtt_state_interval_ms"].get<int>();
     if (j.contains("log_level"))      cfg.log_level       = j["log_level"].get<std::string>();
+    if (j.contains("player_backend")) cfg.player_backend  = j["player_backend"].get<std::string>();
+    if (j.contains("mpv_binary"))     cfg.mpv_binary      = j["mpv_binary"].get<std::string>();
     if (j.contains("mpv_extra_args")) cfg.mpv_extra_args  = j["mpv_extra_args"].get<std::vector<std::string>>();
+    if (j.contains("zap_standby"))    cfg.zap_standby     = j["zap_standby"].get<bool>();
+    if (j.contains("adaptive_buffering")) cfg.adaptive_buffering = j["adaptive_buffering"].get<bool>();
+    if (j.contains("state_dir"))      cfg.state_dir       = j["state_dir"].get<std::string>();
     if (j.contains("ipc_socket_path"))cfg.ipc_socket_path = j["ipc_socket_path"].get<std::string>();
-    if (j.contains("mpv_socket_path"))cfg.mpv_socket_path = j["mpv_socket_path"].get<std::string>();
+    if (j.contains("ipc_max_clients"))cfg.ipc_max_clients = j["ipc_max_clients"].get<int>();
+    if (j.contains("status_page_path")) cfg.status_page_path = j["status_page_path"].get<std::string>();
+
+    // Buffering set by hand in mpv_extra_args wins over learned buffering.
+    if (cfg.adaptive_buffering) {
+        for (auto& arg : cfg.mpv_extra_args) {
+            if (arg.rfind("--cache-secs", 0) == 0 ||
+                arg.rfind("--demuxer-readahead-secs", 0) == 0) {
+                LOG_INFO("adaptive_buffering off: mpv_extra_args sets %s", arg.c_str());
+                cfg.adaptive_buffering = false;
+                break;
+            }
+        }
+    }
     return cfg;
 }
 
@@ -5,16 +5,25 @@
 #include <nlohmann/json.hpp>
 
 inline constexpr const char* DEFAULT_IPC_SOCKET_PATH = "/run/rpiradio/rpiradio.sock";
+inline constexpr const char* DEFAULT_STATUS_PAGE_PATH = "/run/rpiradio/status";
 
 struct Config {
     std::string m3u_path = "/etc/rpiradio/stations.m3u";
     std::string mqtt_host = "localhost";
     int mqtt_port = 1883;
     std::string topic_prefix = "rpiradio";
+    int mqtt_min_interval_ms = 250;
+    int mqtt_state_interval_ms = 5000;
     std::string log_level = "INFO";
+    std::string player_backend = "ipc";
+    std::string mpv_binary = "mpv";
     std::vector<std::string> mpv_extra_args;
+    bool zap_standby = false;
+    bool adaptive_buffering = true;
+    std::string state_dir = "/var/lib/rpiradio";
     std::string ipc_socket_path = DEFAULT_IPC_SOCKET_PATH;
-    std::string mpv_socket_path = "/run/rpiradio/mpv.sock";
+    int ipc_max_clients = 16;
+    std::string status_page_path = DEFAULT_STATUS_PAGE_PATH;
 };
 
 Config config_load();
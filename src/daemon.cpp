@@ -1,212 +1,146 @@
 #include "daemon.h"
 #include "log.h"
 #include "station_manager.h"
-#include "mpv_controller.h"
+#include "station_switcher.h"
+#include "station_stats.h"
+#include "buffer_tuner.h"
 #include "mqtt_publisher.h"
 #include "ipc_server.h"
+#include "status_page.h"
+#include "command_registry.h"
+#include "commands.h"
 #include <sys/epoll.h>
 #include <sys/signalfd.h>
 #include <signal.h>
 #include <unistd.h>
 #include <cstring>
+#include <chrono>
 
 using json = nlohmann::json;
 
 static volatile bool g_running = true;
 
-static void publish_full_state(MqttPublisher& mqtt, MpvController& mpv,
-                                StationManager& sm) {
-    json state;
-    auto* st = sm.current();
-    if (st) {
-        state["station"] = {{"index", sm.current_index() + 1},
-                            {"name", st->name},
-                            {"url", st->url}};
-    }
-    state["playing"] = mpv.is_playing();
-    state["paused"] = mpv.is_paused();
-    state["volume"] = mpv.get_volume();
-    state["metadata"] = mpv.get_metadata();
-    state["station_count"] = sm.count();
-
-    mqtt.publish_state(state.dump());
-}
-
-static void do_play_station(MpvController& mpv, StationManager& sm,
-                             MqttPublisher& mqtt, int index = -1) {
-    if (index >= 0) sm.select(index);
-    auto* st = sm.current();
-    if (!st) return;
-    mpv.play(st->url);
-    mqtt.publish_station(json({{"index", sm.current_index() + 1},
-                                {"name", st->name},
-                                {"url", st->url}}).dump());
-    publish_full_state(mqtt, mpv, sm);
+static void update_status_page(StatusPage& page, Player& mpv, StationManager& sm) {
+    page.publish(snapshot(mpv, sm));
 }
 
-static json handle_ipc(const json& req, Config& cfg,
-                        StationManager& sm, MpvController& mpv,
-                        MqttPublisher& mqtt) {
-    std::string cmd = req.value("command", "");
-    json args = req.value("args", json::object());
-
-    if (cmd == "play") {
-        int station = args.value("station", 0);
-        if (station > 0) {
-            do_play_station(mpv, sm, mqtt, station - 1);
-        } else {
-            auto* st = sm.current();
-            if (st) mpv.play(st->url);
-            publish_full_state(mqtt, mpv, sm);
-        }
-        return {{"status", "ok"}};
-    }
-
-    if (cmd == "stop") {
-        mpv.stop();
-        mqtt.publish_state(json({{"playing", false}, {"paused", false}}).dump());
-        return {{"status", "ok"}};
-    }
-
-    if (cmd == "toggle") {
-        if (!mpv.is_playing() && !mpv.is_paused()) {
-            // Nothing loaded — start playing
-            if (!sm.current() && sm.count() > 0) {
-                sm.select(0);
-            }
-            if (sm.current()) {
-                do_play_station(mpv, sm, mqtt);
-            } else {
-                return {{"status", "error"}, {"message", "no stations available"}};
-            }
-        } else {
-            mpv.toggle_pause();
-            publish_full_state(mqtt, mpv, sm);
-        }
-        return {{"status", "ok"}};
-    }
-
-    if (cmd == "next") {
-        sm.next();
-        do_play_station(mpv, sm, mqtt);
-        return {{"status", "ok"}};
-    }
-
-    if (cmd == "prev") {
-        sm.prev();
-        do_play_station(mpv, sm, mqtt);
-        return {{"status", "ok"}};
-    }
-
-    if (cmd == "volume") {
-        std::string val = args.value("value", "");
-        if (val.empty()) {
-            int v = mpv.get_volume();
-            return {{"status", "ok"}, {"data", v}};
-        }
-        int cur = mpv.get_volume();
-        int target;
-        if (val == "up") {
-            target = cur + 5;
-        } else if (val == "down") {
-            target = cur - 5;
-        } else {
-            target = std::atoi(val.c_str());
-        }
-        mpv.set_volume(target);
-        mqtt.publish_volume(target);
-        return {{"status", "ok"}, {"data", target}};
-    }
-
-    if (cmd == "list") {
-        json arr = json::array();
-        for (auto& s : sm.list()) {
-            arr.push_back({{"name", s.name}, {"url", s.url}});
-        }
-        return {{"status", "ok"}, {"data", arr}};
-    }
+int daemon_run(Config& cfg) {
+    auto start_time = std::chrono::steady_clock::now();
+    LOG_INFO("rpiRadio daemon starting");
 
-    if (cmd == "status") {
-        json state;
-        auto* st = sm.current();
-        if (st) {
-            state["station"] = {{"index", sm.current_index() + 1},
-                                {"name", st->name},
-                                {"url", st->url}};
-        }
-        state["playing"] = mpv.is_playing();
-        state["paused"] = mpv.is_paused();
-        state["volume"] = mpv.get_volume();
-        state["metadata"] = mpv.get_metadata();
-        state["station_count"] = sm.count();
-        return {{"status", "ok"}, {"data", state}};
-    }
+    // Block signals before anything starts threads (libmpv's core and audio
+    // threads inherit the mask); they are read from a signalfd instead.
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGTERM);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGHUP);
+    sigprocmask(SIG_BLOCK, &mask, nullptr);
 
-    if (cmd == "reload") {
-        cfg = config_load();
-        log_init(cfg.log_level);
-        sm.load(cfg.m3u_path);
-        LOG_INFO("config reloaded");
-        return {{"status", "ok"}};
+    // Listen before the slow part of startup (mpv, the broker): clients that
+    // connect meanwhile wait in the backlog and are answered from the first
+    // loop iteration instead of being refused.
+    IpcServer ipc;
+    if (!ipc.start(cfg.ipc_socket_path, cfg.ipc_max_clients)) {
+        LOG_ERROR("failed to start IPC server");
+        return 1;
     }
 
-    return {{"status", "error"}, {"message", "unknown command: " + cmd}};
-}
-
-int daemon_run(Config& cfg) {
-    LOG_INFO("rpiRadio daemon starting");
-
     StationManager sm;
     if (!sm.load(cfg.m3u_path)) {
         LOG_WARN("no stations loaded — continue anyway");
     }
 
-    MpvController mpv;
-    if (!mpv.start(cfg.mpv_socket_path, cfg.mpv_extra_args)) {
+    StationSwitcher sw;
+    PlayerFactory make = [&cfg] { return make_player(cfg.player_backend, cfg.mpv_binary); };
+    if (!sw.start(make, cfg.mpv_extra_args, cfg.zap_standby)) {
         LOG_ERROR("failed to start mpv");
+        ipc.stop();
+        sw.shutdown();
         return 1;
     }
 
+    // Connects in the background; playback does not wait for the broker.
     MqttPublisher mqtt;
     mqtt.set_prefix(cfg.topic_prefix);
+    mqtt.set_min_interval(cfg.mqtt_min_interval_ms);
+    mqtt.set_min_interval("state", cfg.mqtt_state_interval_ms);
     if (!mqtt.connect(cfg.mqtt_host, cfg.mqtt_port)) {
-        LOG_WARN("MQTT connection failed — continuing without MQTT");
+        LOG_WARN("MQTT unavailable — continuing without MQTT");
     }
 
-    IpcServer ipc;
-    if (!ipc.start(cfg.ipc_socket_path)) {
-        LOG_ERROR("failed to start IPC server");
-        mpv.shutdown();
-        return 1;
-    }
+    StatusPage page;
+    if (!cfg.status_page_path.empty() && page.create(cfg.status_page_path))
+        update_status_page(page, sw.active(), sm);
 
-    ipc.set_handler([&](const json& req) -> json {
-        return handle_ipc(req, cfg, sm, mpv, mqtt);
+    StationStats stats;
+    BufferTuner tuner;
+    if (cfg.adaptive_buffering) tuner.load(cfg.state_dir);
+
+    // Local watchers get the same updates as the broker, one JSON line each.
+    mqtt.on_publish([&](const std::string& subtopic, const std::string& payload) {
+        update_status_page(page, sw.active(), sm);
+        if (!ipc.has_watchers()) return;
+        std::string data = subtopic == "metadata" ? json(payload).dump() : payload;
+        ipc.broadcast("{\"event\":\"" + subtopic + "\",\"data\":" + data + "}");
     });
 
-    mpv.on_metadata([&](const std::string& title) {
-        LOG_INFO("metadata: %s", title.c_str());
-        mqtt.publish_metadata(title);
+    // The publisher replays every topic it has a value for after each
+    // CONNACK; this fills in the ones nothing has published yet.
+    mqtt.on_connect([&] { publish_everything(mqtt, sw.active(), sm); });
+
+    CommandRegistry commands;
+    register_commands(commands, cfg, sm, sw, mqtt, stats, tuner);
+
+    ipc.set_handler([&](const json& req) -> json {
+        json resp = commands.dispatch(req, CommandSource::Ipc);
+        update_status_page(page, sw.active(), sm);
+        return resp;
     });
 
-    mpv.on_pause([&](bool paused) {
-        publish_full_state(mqtt, mpv, sm);
-        (void)paused;
+    // Remote control over the broker: {prefix}/cmd/<command>, same commands.
+    mqtt.on_command([&](const json& req) -> json {
+        json resp = commands.dispatch(req, CommandSource::Mqtt);
+        update_status_page(page, sw.active(), sm);
+        return resp;
     });
 
-    // Block signals and use signalfd
-    sigset_t mask;
-    sigemptyset(&mask);
-    sigaddset(&mask, SIGTERM);
-    sigaddset(&mask, SIGINT);
-    sigaddset(&mask, SIGHUP);
-    sigprocmask(SIG_BLOCK, &mask, nullptr);
+    // Both instances report in; only the active one speaks for the radio.
+    for (Player* mpv : sw.instances()) {
+        if (!mpv) continue;
+        mpv->on_metadata([&, mpv](const std::string& title) {
+            if (!sw.is_active(*mpv)) return;
+            LOG_INFO("metadata: %s", title.c_str());
+            mqtt.publish_metadata(title);
+            publish_full_state(mqtt, *mpv, sm);
+        });
+
+        mpv->on_pause([&, mpv](bool paused) {
+            if (!sw.is_active(*mpv)) return;
+            publish_full_state(mqtt, *mpv, sm);
+            (void)paused;
+        });
+
+        // Time-to-first-audio and stalls only matter for what is audible;
+        // End carries played time, which excludes muted (standby) time.
+        mpv->on_telemetry([&, mpv](TelemetryEvent ev, const PlaybackTelemetry& t) {
+            if (ev != TelemetryEvent::End && !sw.is_active(*mpv)) return;
+            stats.record(ev, t);
+            if (cfg.adaptive_buffering) tuner.observe(ev, t);
+        });
+
+        mpv->on_volume([&, mpv](int volume) {
+            if (!sw.is_active(*mpv) || volume < 0) return;
+            mqtt.publish_volume(volume);
+            publish_full_state(mqtt, *mpv, sm);
+        });
+    }
 
     int sig_fd = signalfd(-1, &mask, SFD_NONBLOCK);
     if (sig_fd < 0) {
         LOG_ERROR("signalfd: %s", strerror(errno));
         ipc.stop();
-        mpv.shutdown();
+        sw.shutdown();
         return 1;
     }
 
@@ -215,7 +149,7 @@ int daemon_run(Config& cfg) {
         LOG_ERROR("epoll_create1: %s", strerror(errno));
         close(sig_fd);
         ipc.stop();
-        mpv.shutdown();
+        sw.shutdown();
         return 1;
     }
 
@@ -227,15 +161,66 @@ int daemon_run(Config& cfg) {
         epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
     };
 
+    // Client sockets come and go, and switch to EPOLLOUT while an answer
+    // is only partly written; the broker socket wants EPOLLOUT while
+    // libmosquitto has packets queued.
+    auto watch = [&](int fd, uint32_t events) {
+        struct epoll_event ev{};
+        ev.events = events;
+        ev.data.fd = fd;
+        if (events == 0) {
+            epoll_ctl(epfd, EPOLL_CTL_DEL, fd, nullptr);
+        } else if (epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev) < 0 && errno == ENOENT) {
+            epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+        }
+    };
+    ipc.on_watch(watch);
+    mqtt.on_watch(watch);
+
     add_fd(sig_fd);
     add_fd(ipc.fd());
-    if (mpv.fd() >= 0) add_fd(mpv.fd());
+    for (Player* mpv : sw.instances()) {
+        if (!mpv) continue;
+        add_fd(mpv->fd());
+        add_fd(mpv->pid_fd());
+    }
+
+    sw.on_respawn([&](Player& mpv) {
+        add_fd(mpv.fd());
+        add_fd(mpv.pid_fd());
+    });
+
+    sw.on_load([&](Player& mpv, const std::string& url) {
+        if (cfg.adaptive_buffering) tuner.apply(mpv, url);
+    });
+
+    sw.on_switched([&](const std::string& url, int64_t ms, bool warm) {
+        if (!warm) return;
+        stats.record_warm_switch(url, ms);
+        // The standby's title changes were not published while it was
+        // silent; the swapped-in instance speaks for the radio now.
+        mqtt.publish_metadata(sw.active().get_metadata());
+        publish_full_state(mqtt, sw.active(), sm);
+    });
 
-    LOG_INFO("daemon ready, entering main loop");
+    sw.on_recovered([&](Player& mpv) {
+        if (auto* st = sm.current()) sw.reload(st->url);
+        prepare_standby(sw, sm);
+        publish_full_state(mqtt, mpv, sm);
+    });
 
-    struct epoll_event events[8];
+    LOG_INFO("daemon ready in %lld ms (mpv %lld ms), entering main loop",
+             static_cast<long long>(std::chrono::duration_cast<std::chrono::milliseconds>(
+                 std::chrono::steady_clock::now() - start_time).count()),
+             static_cast<long long>(sw.active().ready_ms()));
+
+    struct epoll_event events[32];
     while (g_running) {
-        int nfds = epoll_wait(epfd, events, 8, -1);
+        int timeout = -1;
+        for (int t : {sw.next_timeout_ms(), ipc.next_timeout_ms(), mqtt.next_timeout_ms()}) {
+            if (t >= 0 && (timeout < 0 || t < timeout)) timeout = t;
+        }
+        int nfds = epoll_wait(epfd, events, 32, timeout);
         if (nfds < 0) {
             if (errno == EINTR) continue;
             LOG_ERROR("epoll_wait: %s", strerror(errno));
@@ -253,25 +238,33 @@ int daemon_run(Config& cfg) {
                         cfg = config_load();
                         log_init(cfg.log_level);
                         sm.load(cfg.m3u_path);
+                        prepare_standby(sw, sm);
+                        update_status_page(page, sw.active(), sm);
                     } else {
                         LOG_INFO("signal %d — shutting down", si.ssi_signo);
                         g_running = false;
                     }
                 }
-            } else if (fd == ipc.fd()) {
-                ipc.handle_connection();
-            } else if (fd == mpv.fd()) {
-                mpv.process_events();
+            } else if (!ipc.handle_fd(fd, events[i].events) &&
+                       !mqtt.handle_fd(fd, events[i].events)) {
+                sw.handle_fd(fd);
             }
         }
+
+        sw.handle_timeouts();
+        ipc.handle_timeouts();
+        mqtt.handle_timeouts();
     }
 
     LOG_INFO("shutting down");
-    close(epfd);
-    close(sig_fd);
+    // The watch callbacks still use epfd, so it goes last.
     ipc.stop();
-    mpv.shutdown();
+    page.close();
+    sw.shutdown();
+    tuner.flush();
     mqtt.disconnect();
+    close(sig_fd);
+    close(epfd);
 
     return 0;
 }
@@ -3,51 +3,147 @@
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <unistd.h>
+#include <cerrno>
 #include <cstring>
 
+static nlohmann::json error(const char* message) {
+    return {{"status", "error"}, {"message", message}};
+}
+
+IpcClient::~IpcClient() {
+    close();
+}
+
 nlohmann::json IpcClient::send(const std::string& socket_path,
                                 const nlohmann::json& request) {
-    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
-    if (fd < 0) {
-        return {{"status", "error"}, {"message", "socket() failed"}};
+    if (!connect(socket_path))
+        return error("cannot connect to daemon (is it running?)");
+    nlohmann::json resp = this->request(request);
+    close();
+    if (hello_refused_) {
+        // Older daemon: the request went out in an encoding it never agreed to.
+        IpcEncoding enc = enc_;
+        enc_ = IpcEncoding::Json;
+        resp = send(socket_path, request);
+        enc_ = enc;
     }
+    return resp;
+}
+
+bool IpcClient::connect(const std::string& socket_path) {
+    close();
+    hello_refused_ = false;
+    fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd_ < 0) return false;
 
     struct sockaddr_un addr{};
     addr.sun_family = AF_UNIX;
     std::strncpy(addr.sun_path, socket_path.c_str(), sizeof(addr.sun_path) - 1);
 
-    if (connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0) {
-        close(fd);
-        return {{"status", "error"},
-                {"message", "cannot connect to daemon (is it running?)"}};
+    if (::connect(fd_, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0) {
+        close();
+        return false;
     }
 
-    struct timeval tv{};
-    tv.tv_sec = 5;
-    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    set_timeout(5000);
+    if (enc_ != IpcEncoding::Json) {
+        std::string hello;
+        ipc_encode(IpcEncoding::Json,
+                   {{"command", "hello"}, {"args", {{"encoding", ipc_encoding_name(enc_)}}}},
+                   hello);
+        if (!write_all(hello)) return false;
+        wire_ = enc_;
+        hello_pending_ = true;
+    }
+    return true;
+}
 
-    std::string msg = request.dump() + "\n";
-    write(fd, msg.c_str(), msg.size());
+void IpcClient::set_timeout(int ms) {
+    if (fd_ < 0) return;
+    struct timeval tv{};
+    tv.tv_sec = ms / 1000;
+    tv.tv_usec = (ms % 1000) * 1000;
+    setsockopt(fd_, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+}
 
-    std::string buf;
-    char tmp[4096];
-    while (true) {
-        ssize_t n = read(fd, tmp, sizeof(tmp) - 1);
-        if (n <= 0) break;
-        buf.append(tmp, static_cast<size_t>(n));
-        if (buf.find('\n') != std::string::npos) break;
+void IpcClient::close() {
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
     }
+    rx_.clear();
+    wire_ = IpcEncoding::Json;
+    hello_pending_ = false;
+}
+
+nlohmann::json IpcClient::request(const nlohmann::json& req) {
+    if (!post(req)) return error("cannot send to daemon");
+    return receive();
+}
 
-    close(fd);
+bool IpcClient::post(const nlohmann::json& req) {
+    if (fd_ < 0) return false;
+    std::string msg;
+    ipc_encode(wire_, req, msg);
+    return write_all(msg);
+}
 
-    auto pos = buf.find('\n');
-    if (pos == std::string::npos) {
-        return {{"status", "error"}, {"message", "no response from daemon"}};
+bool IpcClient::write_all(const std::string& msg) {
+    size_t off = 0;
+    while (off < msg.size()) {
+        ssize_t n = ::send(fd_, msg.data() + off, msg.size() - off, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            close();
+            return false;
+        }
+        off += static_cast<size_t>(n);
     }
+    return true;
+}
 
-    try {
-        return nlohmann::json::parse(buf.substr(0, pos));
-    } catch (const nlohmann::json::exception& e) {
-        return {{"status", "error"}, {"message", e.what()}};
+bool IpcClient::read_message(IpcEncoding enc, std::string_view& msg, const char*& err) {
+    while (true) {
+        int r = enc == IpcEncoding::Json ? (rx_.next_line(msg) ? 1 : 0)
+                                         : rx_.next_frame(msg);
+        if (r > 0) return true;
+        if (r < 0) {
+            close();
+            err = "oversized response from daemon";
+            return false;
+        }
+        ssize_t n = rx_.fill(fd_);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            close();
+            err = "no response from daemon";
+            return false;
+        }
     }
 }
+
+bool IpcClient::handshake() {
+    if (fd_ < 0) return false;
+    if (!hello_pending_) return true;
+    // The hello's answer comes first, as a JSON line.
+    std::string_view msg;
+    const char* err = nullptr;
+    if (!read_message(IpcEncoding::Json, msg, err)) return false;
+    auto resp = ipc_decode(IpcEncoding::Json, msg);
+    hello_pending_ = false;
+    hello_refused_ = !resp.is_object() || resp.value("status", "") != "ok";
+    if (hello_refused_) close();
+    return !hello_refused_;
+}
+
+nlohmann::json IpcClient::receive() {
+    if (fd_ < 0) return error("not connected to daemon");
+    if (hello_pending_ && !handshake())
+        return error(hello_refused_ ? "daemon refused the encoding" : "no response from daemon");
+    std::string_view msg;
+    const char* err = nullptr;
+    if (!read_message(wire_, msg, err)) return error(err);
+    auto resp = ipc_decode(wire_, msg);
+    if (resp.is_discarded()) return error("invalid response from daemon");
+    return resp;
+}
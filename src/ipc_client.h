@@ -1,9 +1,56 @@
 #pragma once
 
+#include "ipc_codec.h"
+#include "line_buffer.h"
 #include <string>
 #include <nlohmann/json.hpp>
 
+// Client side of the daemon's IPC socket. send() is a one-shot round trip;
+// connect() opens a session that carries any number of requests, which can
+// be pipelined with post() / receive() (answers come back in order).
+// With set_encoding(), connect() also sends a hello and switches to binary
+// frames straight away, without waiting for the answer; a daemon that
+// refuses makes send() retry in JSON.
 class IpcClient {
 public:
+    IpcClient() = default;
+    ~IpcClient();
+    IpcClient(const IpcClient&) = delete;
+    IpcClient& operator=(const IpcClient&) = delete;
+
+    // One request on a connection of its own.
     nlohmann::json send(const std::string& socket_path, const nlohmann::json& request);
+
+    // Takes effect on the next connect(). Json (the default) sends no hello.
+    void set_encoding(IpcEncoding enc) { enc_ = enc; }
+
+    bool connect(const std::string& socket_path);
+    void close();
+    bool is_connected() const { return fd_ >= 0; }
+    // Waits for the answer to connect()'s hello, if one was sent. False if
+    // the daemon refused the encoding (the connection is then closed; connect
+    // again in JSON) or went away.
+    bool handshake();
+    // How long receive() waits for the daemon; 0 waits forever (watch).
+    void set_timeout(int ms);
+
+    // Sends a request (an object, or an array for a batch) and waits for its
+    // answer. Only use on a session with nothing posted and not yet received.
+    nlohmann::json request(const nlohmann::json& req);
+    // Sends without waiting; each post() is answered by one receive().
+    bool post(const nlohmann::json& req);
+    // Next answer, or an error object if the daemon went away or timed out.
+    nlohmann::json receive();
+
+private:
+    bool write_all(const std::string& msg);
+    // Next message framed for enc; on failure closes and sets err.
+    bool read_message(IpcEncoding enc, std::string_view& msg, const char*& err);
+
+    int fd_ = -1;
+    IpcEncoding enc_ = IpcEncoding::Json;   // requested
+    IpcEncoding wire_ = IpcEncoding::Json;  // in use on this connection
+    bool hello_pending_ = false;            // its answer is the next message
+    bool hello_refused_ = false;
+    LineBuffer rx_{4096, 64 << 20};
 };
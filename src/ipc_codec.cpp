@@ -0,0 +1,52 @@
+#include "ipc_codec.h"
+#include <cstdint>
+
+const char* ipc_encoding_name(IpcEncoding enc) {
+    switch (enc) {
+    case IpcEncoding::Json:    return "json";
+    case IpcEncoding::Cbor:    return "cbor";
+    case IpcEncoding::MsgPack: return "msgpack";
+    }
+    return "json";
+}
+
+bool ipc_encoding_from_name(std::string_view name, IpcEncoding& enc) {
+    if (name == "json")    enc = IpcEncoding::Json;
+    else if (name == "cbor")    enc = IpcEncoding::Cbor;
+    else if (name == "msgpack") enc = IpcEncoding::MsgPack;
+    else return false;
+    return true;
+}
+
+void ipc_encode(IpcEncoding enc, const nlohmann::json& msg, std::string& out) {
+    if (enc == IpcEncoding::Json) {
+        out += msg.dump();
+        out += '\n';
+        return;
+    }
+    size_t header = out.size();
+    out.append(IPC_FRAME_HEADER, '\0');
+    // The string output adapter appends, so the payload lands after the
+    // header without an intermediate buffer.
+    if (enc == IpcEncoding::Cbor)
+        nlohmann::json::to_cbor(msg, out);
+    else
+        nlohmann::json::to_msgpack(msg, out);
+    auto len = static_cast<std::uint32_t>(out.size() - header - IPC_FRAME_HEADER);
+    out[header]     = static_cast<char>(len >> 24);
+    out[header + 1] = static_cast<char>(len >> 16);
+    out[header + 2] = static_cast<char>(len >> 8);
+    out[header + 3] = static_cast<char>(len);
+}
+
+nlohmann::json ipc_decode(IpcEncoding enc, std::string_view body) {
+    switch (enc) {
+    case IpcEncoding::Json:
+        return nlohmann::json::parse(body, nullptr, false);
+    case IpcEncoding::Cbor:
+        return nlohmann::json::from_cbor(body, true, false);
+    case IpcEncoding::MsgPack:
+        return nlohmann::json::from_msgpack(body, true, false);
+    }
+    return nlohmann::json(nlohmann::json::value_t::discarded);
+}
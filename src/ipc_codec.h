@@ -0,0 +1,25 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <nlohmann/json.hpp>
+
+// Wire encodings of the IPC protocol. Every connection starts as JSON lines;
+// a "hello" request can switch it to CBOR or MessagePack, after which each
+// message in either direction is a frame: a 4-byte big-endian payload
+// length followed by the encoded payload.
+enum class IpcEncoding {
+    Json,
+    Cbor,
+    MsgPack,
+};
+
+inline constexpr size_t IPC_FRAME_HEADER = 4;
+
+const char* ipc_encoding_name(IpcEncoding enc);
+bool ipc_encoding_from_name(std::string_view name, IpcEncoding& enc);
+
+// Appends one message: a JSON line, or a frame.
+void ipc_encode(IpcEncoding enc, const nlohmann::json& msg, std::string& out);
+// Decodes a line or a frame payload; a discarded value if it is malformed.
+nlohmann::json ipc_decode(IpcEncoding enc, std::string_view body);
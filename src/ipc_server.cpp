@@ -1,16 +1,61 @@
 #include "ipc_server.h"
+#include "ipc_codec.h"
 #include "log.h"
+#include <sys/epoll.h>
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <algorithm>
+#include <cstdlib>
 #include <cstring>
 
-bool IpcServer::start(const std::string& socket_path) {
+// The listening socket systemd passed under the sd_listen_fds(3) protocol,
+// or -1. The variables are cleared so mpv children do not see them.
+static int inherited_socket() {
+    const char* pid = getenv("LISTEN_PID");
+    const char* fds = getenv("LISTEN_FDS");
+    int n = fds ? std::atoi(fds) : 0;
+    bool ours = pid && std::strtol(pid, nullptr, 10) == getpid();
+    unsetenv("LISTEN_PID");
+    unsetenv("LISTEN_FDS");
+    unsetenv("LISTEN_FDNAMES");
+    if (!ours || n < 1) return -1;
+    if (n > 1) LOG_WARN("socket activation passed %d sockets, using the first", n);
+
+    const int fd = 3;    // SD_LISTEN_FDS_START
+    int type = 0, listening = 0;
+    socklen_t len = sizeof(type);
+    if (getsockopt(fd, SOL_SOCKET, SO_TYPE, &type, &len) < 0 || type != SOCK_STREAM) {
+        LOG_ERROR("inherited fd %d is not a stream socket", fd);
+        return -1;
+    }
+    len = sizeof(listening);
+    if (getsockopt(fd, SOL_SOCKET, SO_ACCEPTCONN, &listening, &len) < 0 || !listening) {
+        LOG_ERROR("inherited fd %d is not listening", fd);
+        return -1;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    return fd;
+}
+
+bool IpcServer::start(const std::string& socket_path, int max_clients) {
+    max_clients_ = static_cast<size_t>(std::max(1, max_clients));
+
+    listen_fd_ = inherited_socket();
+    if (listen_fd_ >= 0) {
+        // systemd owns the path and keeps the socket across restarts; stop()
+        // must leave it alone.
+        LOG_INFO("IPC server using socket-activated fd %d (max %zu clients)",
+                 listen_fd_, max_clients_);
+        return true;
+    }
+
     socket_path_ = socket_path;
     unlink(socket_path.c_str());
 
-    listen_fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+    listen_fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
     if (listen_fd_ < 0) {
         LOG_ERROR("socket(): %s", strerror(errno));
         return false;
@@ -27,21 +72,21 @@ bool IpcServer::start(const std::string& socket_path) {
         return false;
     }
 
-    if (listen(listen_fd_, 4) < 0) {
+    // Bursts of clients wait in the kernel's queue, not in connect().
+    if (listen(listen_fd_, SOMAXCONN) < 0) {
         LOG_ERROR("listen(): %s", strerror(errno));
         close(listen_fd_);
         listen_fd_ = -1;
         return false;
     }
 
-    int flags = fcntl(listen_fd_, F_GETFL, 0);
-    fcntl(listen_fd_, F_SETFL, flags | O_NONBLOCK);
-
-    LOG_INFO("IPC server listening on %s", socket_path.c_str());
+    LOG_INFO("IPC server listening on %s (max %zu clients)", socket_path.c_str(),
+             max_clients_);
     return true;
 }
 
 void IpcServer::stop() {
+    while (!clients_.empty()) close_client(clients_.begin()->first);
     if (listen_fd_ >= 0) {
         close(listen_fd_);
         listen_fd_ = -1;
@@ -52,34 +97,256 @@ void IpcServer::stop() {
     }
 }
 
-void IpcServer::handle_connection() {
-    int client = accept(listen_fd_, nullptr, nullptr);
-    if (client < 0) return;
+bool IpcServer::handle_fd(int fd, uint32_t events) {
+    if (fd < 0) return false;
+    if (fd == listen_fd_) {
+        accept_clients();
+        return true;
+    }
+    auto it = clients_.find(fd);
+    if (it == clients_.end()) return false;
 
-    struct timeval tv{};
-    tv.tv_sec = 2;
-    setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    Client& c = it->second;
+    if (events & EPOLLERR) {
+        close_client(fd);
+        return true;
+    }
+    if (events & EPOLLHUP) {
+        // Gone in both directions: what it sent before closing still runs,
+        // but the answers cannot be delivered.
+        read_client(fd, c, true);
+        return true;
+    }
+    if ((events & EPOLLOUT) && !write_client(fd, c)) return true;
+    if (events & EPOLLIN) read_client(fd, c);
+    return true;
+}
 
-    std::string buf;
-    char tmp[4096];
+void IpcServer::accept_clients() {
     while (true) {
-        ssize_t n = read(client, tmp, sizeof(tmp) - 1);
-        if (n <= 0) break;
-        buf.append(tmp, static_cast<size_t>(n));
-        if (buf.find('\n') != std::string::npos) break;
+        int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                LOG_WARN("accept: %s", strerror(errno));
+            if (errno == EINTR) continue;
+            return;
+        }
+        if (clients_.size() >= max_clients_) {
+            LOG_WARN("IPC: %zu clients connected, refusing another", clients_.size());
+            static const char busy[] =
+                "{\"message\":\"too many clients\",\"status\":\"error\"}\n";
+            send(fd, busy, sizeof(busy) - 1, MSG_NOSIGNAL | MSG_DONTWAIT);
+            close(fd);
+            continue;
+        }
+        Client& c = clients_[fd];
+        touch(c);
+        update_watch(fd, c);
     }
+}
 
-    auto pos = buf.find('\n');
-    if (pos == std::string::npos) {
-        close(client);
+void IpcServer::read_client(int fd, Client& c, bool hangup) {
+    while (!c.eof && (hangup || c.tx.size() - c.tx_off < MAX_PENDING_OUTPUT)) {
+        ssize_t n = c.rx.fill(fd);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            close_client(fd);
+            return;
+        }
+        if (n == 0) {
+            // Half-close: answer what has arrived, then hang up.
+            c.eof = true;
+            break;
+        }
+        // A hello may switch the encoding mid-buffer; the rest of the
+        // buffer is then read as frames.
+        std::string_view msg;
+        while (true) {
+            if (c.enc == IpcEncoding::Json) {
+                if (!c.rx.next_line(msg)) break;
+                if (msg.empty()) continue;
+            } else {
+                int r = c.rx.next_frame(msg);
+                if (r == 0) break;
+                if (r < 0) {
+                    LOG_WARN("IPC: oversized frame, closing client");
+                    close_client(fd);
+                    return;
+                }
+            }
+            dispatching_fd_ = fd;
+            dispatch(c, msg);
+            dispatching_fd_ = -1;
+            c.session = true;
+            if (hangup) {
+                c.tx.clear();
+                c.tx_off = 0;
+            }
+        }
+    }
+    if (hangup) {
+        close_client(fd);
         return;
     }
+    touch(c);
+    write_client(fd, c);
+}
+
+bool IpcServer::write_client(int fd, Client& c) {
+    while (c.tx_off < c.tx.size() || refill(c)) {
+        ssize_t n = send(fd, c.tx.data() + c.tx_off, c.tx.size() - c.tx_off,
+                         MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            close_client(fd);
+            return false;
+        }
+        c.tx_off += static_cast<size_t>(n);
+        touch(c);
+    }
+    if (c.tx_off == c.tx.size()) {
+        c.tx.clear();
+        c.tx_off = 0;
+        // A watcher that half-closed still wants its events.
+        if (c.eof && !c.watching) {
+            close_client(fd);
+            return false;
+        }
+    }
+    update_watch(fd, c);
+    return true;
+}
+
+bool IpcServer::refill(Client& c) {
+    if (c.queue.empty() && c.dropped == 0) return false;
+    c.tx.erase(0, c.tx_off);
+    c.tx_off = 0;
+    if (c.dropped) {
+        ipc_encode(c.enc, {{"event", "dropped"}, {"data", c.dropped}}, c.tx);
+        c.dropped = 0;
+    }
+    for (auto& e : c.queue) {
+        if (c.enc == IpcEncoding::Json) {
+            c.tx += e;
+            c.tx += '\n';
+        } else {
+            ipc_encode(c.enc, nlohmann::json::parse(e, nullptr, false), c.tx);
+        }
+    }
+    c.queue.clear();
+    return true;
+}
+
+void IpcServer::broadcast(const std::string& event) {
+    if (watchers_ == 0) return;
+    for (auto it = clients_.begin(); it != clients_.end();) {
+        int fd = it->first;
+        Client& c = it->second;
+        ++it;
+        if (!c.watching) continue;
+        if (c.queue.size() >= WATCH_QUEUE) {
+            c.queue.pop_front();
+            ++c.dropped;
+        }
+        c.queue.push_back(event);
+        // Behind on earlier output: the queue is drained on EPOLLOUT. The
+        // client whose request caused the event is written (and possibly
+        // closed) by read_client once dispatch returns.
+        if (c.tx_off == c.tx.size() && fd != dispatching_fd_) write_client(fd, c);
+    }
+}
+
+void IpcServer::update_watch(int fd, Client& c) {
+    // Read while there is room for more answers; write while some are unsent.
+    size_t pending = c.tx.size() - c.tx_off;
+    uint32_t events = 0;
+    if (!c.eof && pending < MAX_PENDING_OUTPUT) events |= EPOLLIN;
+    if (pending > 0) events |= EPOLLOUT;
+    if (events == c.events) return;
+    c.events = events;
+    watch(fd, events);
+}
+
+void IpcServer::touch(Client& c) {
+    // Watchers are quiet by design; they leave by closing the connection.
+    if (c.watching) {
+        c.deadline = Clock::time_point::max();
+        return;
+    }
+    c.deadline = Clock::now() + std::chrono::milliseconds(
+        c.session ? SESSION_IDLE_MS : REQUEST_TIMEOUT_MS);
+}
+
+void IpcServer::close_client(int fd) {
+    auto it = clients_.find(fd);
+    if (it != clients_.end() && it->second.watching) --watchers_;
+    watch(fd, 0);
+    close(fd);
+    clients_.erase(fd);
+}
+
+// The request's command name; "" if absent or not a string (the handler
+// reports those).
+static std::string command_of(const nlohmann::json& request) {
+    auto it = request.find("command");
+    return it != request.end() && it->is_string() ? it->get<std::string>() : "";
+}
+
+void IpcServer::dispatch(Client& c, std::string_view msg) {
+    nlohmann::json response;
+    auto request = ipc_decode(c.enc, msg);
+    if (request.is_discarded()) {
+        response = {{"status", "error"},
+                    {"message", std::string("invalid ") + ipc_encoding_name(c.enc) +
+                                " request"}};
+    } else if (request.is_object() && command_of(request) == "hello") {
+        hello(c, request);
+        return;
+    } else if (request.is_array()) {
+        LOG_DEBUG("IPC batch of %zu", request.size());
+        if (request.empty()) {
+            response = {{"status", "error"}, {"message", "empty batch"}};
+        } else {
+            response = nlohmann::json::array();
+            for (auto& r : request) response.push_back(run(c, r));
+        }
+    } else {
+        response = run(c, request);
+    }
+    ipc_encode(c.enc, response, c.tx);
+}
+
+void IpcServer::hello(Client& c, const nlohmann::json& request) {
+    // Answered in the encoding the hello arrived in; what follows uses the
+    // new one.
+    nlohmann::json args = request.value("args", nlohmann::json::object());
+    std::string name = args.is_object() ? args.value("encoding", "json") : "";
+    IpcEncoding enc;
+    nlohmann::json response;
+    if (ipc_encoding_from_name(name, enc)) {
+        response = {{"status", "ok"}, {"data", {{"encoding", name}}}};
+    } else {
+        response = {{"status", "error"}, {"message", "unsupported encoding: " + name}};
+        enc = c.enc;
+    }
+    auto id = request.find("id");
+    if (id != request.end()) response["id"] = *id;
+    ipc_encode(c.enc, response, c.tx);
+    c.enc = enc;
+}
+
+nlohmann::json IpcServer::run(Client& c, const nlohmann::json& request) {
+    if (!request.is_object())
+        return {{"status", "error"}, {"message", "request must be an object"}};
+    std::string command = command_of(request);
+    if (command == "hello")
+        return {{"status", "error"}, {"message", "hello cannot be batched"}};
+    LOG_DEBUG("IPC request: %s", command.c_str());
 
-    std::string line = buf.substr(0, pos);
     nlohmann::json response;
     try {
-        auto request = nlohmann::json::parse(line);
-        LOG_DEBUG("IPC request: %s", line.c_str());
         if (handler_) {
             response = handler_(request);
         } else {
@@ -88,8 +355,44 @@ void IpcServer::handle_connection() {
     } catch (const nlohmann::json::exception& e) {
         response = {{"status", "error"}, {"message", e.what()}};
     }
+    if (!c.watching && command == "watch" &&
+        response.value("status", "") == "ok") {
+        c.watching = true;
+        ++watchers_;
+    }
+    auto id = request.find("id");
+    if (id != request.end()) response["id"] = *id;
+    return response;
+}
+
+void IpcServer::watch(int fd, uint32_t events) {
+    if (watch_cb_) watch_cb_(fd, events);
+}
 
-    std::string resp_str = response.dump() + "\n";
-    write(client, resp_str.c_str(), resp_str.size());
-    close(client);
+int IpcServer::next_timeout_ms() const {
+    auto earliest = Clock::time_point::max();
+    for (auto& [fd, c] : clients_) earliest = std::min(earliest, c.deadline);
+    if (earliest == Clock::time_point::max()) return -1;
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+        earliest - Clock::now()).count();
+    return ms > 0 ? static_cast<int>(ms) + 1 : 0;
+}
+
+void IpcServer::handle_timeouts() {
+    auto now = Clock::now();
+    for (auto it = clients_.begin(); it != clients_.end();) {
+        int fd = it->first;
+        bool expired = it->second.deadline <= now;
+        bool session = it->second.session;
+        ++it;
+        if (expired) {
+            if (session) {
+                LOG_DEBUG("IPC session idle, closing");
+            } else {
+                LOG_WARN("IPC client sent no request within %d ms, closing",
+                         REQUEST_TIMEOUT_MS);
+            }
+            close_client(fd);
+        }
+    }
 }
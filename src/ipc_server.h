@@ -1,21 +1,106 @@
 #pragma once
 
+#include "ipc_codec.h"
+#include "line_buffer.h"
+#include <chrono>
+#include <cstdint>
+#include <deque>
 #include <string>
 #include <functional>
+#include <unordered_map>
 #include <nlohmann/json.hpp>
 
+// Unix socket server for the CLI. Every client is non-blocking and watched
+// by the daemon's event loop, so a slow client only ever holds up itself.
+//
+// A connection carries any number of newline-delimited requests; they may be
+// pipelined and are answered in order, one line each. A request's "id", if
+// present, is copied into its response. A JSON array is a batch: its
+// requests run back to back, with nothing from other clients in between,
+// and are answered with one array. Clients that go quiet are dropped by
+// handle_timeouts().
+//
+// A client whose "watch" request succeeded also receives every broadcast()
+// event line. Events wait in a bounded per-client queue while the client is
+// behind; when it is full the oldest are dropped and a "dropped" event with
+// the count goes out ahead of the rest.
+//
+// {"command": "hello", "args": {"encoding": "cbor" | "msgpack" | "json"}}
+// switches the connection to another encoding (see ipc_codec.h). It is
+// answered in the old encoding; everything after it uses the new one.
 class IpcServer {
 public:
     using Handler = std::function<nlohmann::json(const nlohmann::json& request)>;
+    // Asks the owner to watch fd for events (EPOLLIN / EPOLLOUT), or to stop
+    // watching it when events is 0. The listening socket is not included.
+    using WatchCallback = std::function<void(int fd, uint32_t events)>;
 
-    bool start(const std::string& socket_path);
+    // Time allowed for the first request, and between requests after it.
+    static constexpr int REQUEST_TIMEOUT_MS = 5000;
+    static constexpr int SESSION_IDLE_MS = 60000;
+    // Stop reading a client's requests while this much of its output is unsent.
+    static constexpr size_t MAX_PENDING_OUTPUT = 256 * 1024;
+    static constexpr size_t WATCH_QUEUE = 64;
+
+    // Listens on socket_path, or on the socket systemd passed (LISTEN_FDS)
+    // if the daemon was socket-activated. Connections are only accepted
+    // from handle_fd(), so anything arriving before the event loop runs
+    // waits in the kernel's queue and is answered once the daemon is up.
+    bool start(const std::string& socket_path, int max_clients = 16);
     void stop();
     int fd() const { return listen_fd_; }
-    void handle_connection();
+    // Routes an epoll event to the listener or a client; false if fd is not ours.
+    bool handle_fd(int fd, uint32_t events);
     void set_handler(Handler h) { handler_ = std::move(h); }
+    void on_watch(WatchCallback cb) { watch_cb_ = std::move(cb); }
+    size_t client_count() const { return clients_.size(); }
+    bool has_watchers() const { return watchers_ > 0; }
+
+    // Queues one event line (without '\n') for every watching client.
+    void broadcast(const std::string& event);
+
+    // Milliseconds until the next client idles out, -1 if none are connected.
+    int next_timeout_ms() const;
+    void handle_timeouts();
 
 private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Client {
+        LineBuffer rx{1024};
+        std::string tx;
+        size_t tx_off = 0;
+        uint32_t events = 0;       // currently watched
+        IpcEncoding enc = IpcEncoding::Json;
+        bool session = false;      // has sent at least one request
+        bool eof = false;          // peer is done sending; close once tx drains
+        bool watching = false;
+        std::deque<std::string> queue;   // events not yet in tx
+        uint32_t dropped = 0;      // events lost since the last delivery
+        Clock::time_point deadline;
+    };
+
+    void accept_clients();
+    // With hangup, runs everything buffered, drops the answers and closes.
+    void read_client(int fd, Client& c, bool hangup = false);
+    // False once the client has been closed.
+    bool write_client(int fd, Client& c);
+    void close_client(int fd);
+    void update_watch(int fd, Client& c);
+    void touch(Client& c);
+    void dispatch(Client& c, std::string_view msg);
+    void hello(Client& c, const nlohmann::json& request);
+    nlohmann::json run(Client& c, const nlohmann::json& request);
+    // Moves queued events into tx once earlier output has been written.
+    bool refill(Client& c);
+    void watch(int fd, uint32_t events);
+
     int listen_fd_ = -1;
-    std::string socket_path_;
+    std::string socket_path_;    // empty when socket-activated: not ours to unlink
+    size_t max_clients_ = 16;
     Handler handler_;
+    WatchCallback watch_cb_;
+    std::unordered_map<int, Client> clients_;
+    size_t watchers_ = 0;
+    int dispatching_fd_ = -1;    // client whose request is running
 };
@@ -0,0 +1,422 @@
+#include "libmpv_player.h"
+
+#ifdef HAVE_LIBMPV
+
+#include "log.h"
+#include <mpv/client.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstring>
+#include <string_view>
+
+namespace {
+
+// mpv_observe_property reply ids; mpv echoes them in property-change events.
+enum : int {
+    OBS_METADATA = 1,
+    OBS_PAUSE,
+    OBS_VOLUME,
+    OBS_MEDIA_TITLE,
+    OBS_IDLE_ACTIVE,
+    OBS_CORE_IDLE,
+    OBS_CACHE_DURATION,
+    OBS_AUDIO_PARAMS,
+    OBS_VOLUME_MAX,
+    OBS_PAUSED_FOR_CACHE,
+    OBS_CACHE_BUFFERING,
+    OBS_MUTE,
+};
+
+struct ObservedProperty {
+    int id;
+    const char* name;
+    mpv_format format;
+};
+
+constexpr ObservedProperty OBSERVED_PROPERTIES[] = {
+    {OBS_METADATA,       "metadata",               MPV_FORMAT_NODE},
+    {OBS_PAUSE,          "pause",                  MPV_FORMAT_FLAG},
+    {OBS_VOLUME,         "volume",                 MPV_FORMAT_DOUBLE},
+    {OBS_MEDIA_TITLE,    "media-title",            MPV_FORMAT_STRING},
+    {OBS_IDLE_ACTIVE,    "idle-active",            MPV_FORMAT_FLAG},
+    {OBS_CORE_IDLE,      "core-idle",              MPV_FORMAT_FLAG},
+    {OBS_CACHE_DURATION, "demuxer-cache-duration", MPV_FORMAT_DOUBLE},
+    {OBS_AUDIO_PARAMS,   "audio-params",           MPV_FORMAT_NODE},
+    {OBS_VOLUME_MAX,     "volume-max",             MPV_FORMAT_DOUBLE},
+    {OBS_PAUSED_FOR_CACHE, "paused-for-cache",       MPV_FORMAT_FLAG},
+    {OBS_CACHE_BUFFERING,  "cache-buffering-state",  MPV_FORMAT_INT64},
+    {OBS_MUTE,           "mute",                   MPV_FORMAT_FLAG},
+};
+
+template <typename T>
+bool update(T& field, const T& value) {
+    if (field == value) return false;
+    field = value;
+    return true;
+}
+
+// Looks up key in an MPV_FORMAT_NODE_MAP; null if absent or not a map.
+const mpv_node* map_get(const mpv_node* node, const char* key) {
+    if (!node || node->format != MPV_FORMAT_NODE_MAP) return nullptr;
+    const mpv_node_list* list = node->u.list;
+    for (int i = 0; i < list->num; ++i) {
+        if (std::strcmp(list->keys[i], key) == 0) return &list->values[i];
+    }
+    return nullptr;
+}
+
+std::string node_string(const mpv_node* node) {
+    return node && node->format == MPV_FORMAT_STRING ? node->u.string : "";
+}
+
+int node_int(const mpv_node* node) {
+    return node && node->format == MPV_FORMAT_INT64 ? static_cast<int>(node->u.int64) : 0;
+}
+
+// Splits "--name=value" / "--no-name" / "--name" into an mpv option pair.
+void parse_option(std::string_view arg, std::string& name, std::string& value) {
+    if (arg.substr(0, 2) == "--") arg.remove_prefix(2);
+    size_t eq = arg.find('=');
+    if (eq != std::string_view::npos) {
+        name = arg.substr(0, eq);
+        value = arg.substr(eq + 1);
+    } else if (arg.substr(0, 3) == "no-") {
+        name = arg.substr(3);
+        value = "no";
+    } else {
+        name = arg;
+        value = "yes";
+    }
+}
+
+} // namespace
+
+LibmpvPlayer::~LibmpvPlayer() {
+    shutdown();
+}
+
+void LibmpvPlayer::wakeup(void* ctx) {
+    // Runs on an mpv thread: only poke the eventfd.
+    uint64_t one = 1;
+    ssize_t n = write(static_cast<LibmpvPlayer*>(ctx)->wakeup_fd_, &one, sizeof(one));
+    (void)n;
+}
+
+bool LibmpvPlayer::start(const std::vector<std::string>& extra_args) {
+    auto t0 = Clock::now();
+    mpv_ = mpv_create();
+    if (!mpv_) {
+        LOG_ERROR("mpv_create failed");
+        return false;
+    }
+
+    mpv_set_option_string(mpv_, "idle", "yes");
+    mpv_set_option_string(mpv_, "vid", "no");
+    mpv_set_option_string(mpv_, "terminal", "no");
+    for (auto& a : extra_args) {
+        std::string name, value;
+        parse_option(a, name, value);
+        int rc = mpv_set_option_string(mpv_, name.c_str(), value.c_str());
+        if (rc < 0)
+            LOG_WARN("mpv option %s: %s", a.c_str(), mpv_error_string(rc));
+    }
+
+    int rc = mpv_initialize(mpv_);
+    if (rc < 0) {
+        LOG_ERROR("mpv_initialize: %s", mpv_error_string(rc));
+        mpv_terminate_destroy(mpv_);
+        mpv_ = nullptr;
+        return false;
+    }
+
+    wakeup_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wakeup_fd_ < 0) {
+        LOG_ERROR("eventfd: %s", strerror(errno));
+        mpv_terminate_destroy(mpv_);
+        mpv_ = nullptr;
+        return false;
+    }
+    mpv_set_wakeup_callback(mpv_, &LibmpvPlayer::wakeup, this);
+
+    // Like observe_property over IPC, each observation queues an initial
+    // property-change that seeds the cache.
+    for (auto& p : OBSERVED_PROPERTIES) {
+        mpv_observe_property(mpv_, static_cast<uint64_t>(p.id), p.name, p.format);
+    }
+
+    ready_ = true;
+    ready_ms_ = std::chrono::duration_cast<std::chrono::milliseconds>(
+        Clock::now() - t0).count();
+    char* version = mpv_get_property_string(mpv_, "mpv-version");
+    LOG_INFO("libmpv ready in %lld ms (%s)", static_cast<long long>(ready_ms_),
+             version ? version : "unknown");
+    mpv_free(version);
+    return true;
+}
+
+void LibmpvPlayer::shutdown() {
+    if (mpv_) {
+        mpv_set_wakeup_callback(mpv_, nullptr, nullptr);
+        mpv_terminate_destroy(mpv_);
+        mpv_ = nullptr;
+    }
+    if (wakeup_fd_ >= 0) { close(wakeup_fd_); wakeup_fd_ = -1; }
+
+    auto pending = std::move(pending_);
+    pending_.clear();
+    for (auto& [id, cb] : pending) {
+        if (cb) cb(false);
+    }
+    reset_state();
+}
+
+uint64_t LibmpvPlayer::track(DoneCallback cb) {
+    if (!cb) return 0;
+    uint64_t id = next_reply_id_++;
+    pending_[id] = std::move(cb);
+    return id;
+}
+
+bool LibmpvPlayer::command(std::initializer_list<const char*> args,
+                           DoneCallback cb) {
+    if (!mpv_) {
+        if (cb) cb(false);
+        return false;
+    }
+    std::vector<const char*> argv(args);
+    argv.push_back(nullptr);
+    uint64_t id = track(std::move(cb));
+    int rc = mpv_command_async(mpv_, id, argv.data());
+    if (rc < 0) {
+        LOG_WARN("mpv %s: %s", argv[0], mpv_error_string(rc));
+        auto it = pending_.find(id);
+        if (it != pending_.end()) {
+            DoneCallback done = std::move(it->second);
+            pending_.erase(it);
+            done(false);
+        }
+        return false;
+    }
+    return true;
+}
+
+bool LibmpvPlayer::set_property(const char* name, int format, void* data,
+                                DoneCallback cb) {
+    if (!mpv_) {
+        if (cb) cb(false);
+        return false;
+    }
+    uint64_t id = track(std::move(cb));
+    int rc = mpv_set_property_async(mpv_, id, name,
+                                    static_cast<mpv_format>(format), data);
+    if (rc < 0) {
+        LOG_WARN("mpv set %s: %s", name, mpv_error_string(rc));
+        auto it = pending_.find(id);
+        if (it != pending_.end()) {
+            DoneCallback done = std::move(it->second);
+            pending_.erase(it);
+            done(false);
+        }
+        return false;
+    }
+    return true;
+}
+
+bool LibmpvPlayer::play(const std::string& url) {
+    LOG_INFO("play: %s", url.c_str());
+    bool ok = set_pause(false) && command({"loadfile", url.c_str(), "replace"});
+    if (ok) {
+        playing_ = true;
+        telemetry_load(url);
+    }
+    return ok;
+}
+
+bool LibmpvPlayer::stop() {
+    LOG_INFO("stop");
+    bool ok = command({"stop"}) && set_pause(false);
+    if (ok) {
+        playing_ = false;
+        telemetry_end();
+    }
+    return ok;
+}
+
+bool LibmpvPlayer::toggle_pause() {
+    if (!command({"cycle", "pause"})) return false;
+    // The cache follows the observed "pause" property, as with the IPC backend.
+    LOG_INFO("pause toggle sent");
+    return true;
+}
+
+bool LibmpvPlayer::set_volume(int vol) {
+    vol = std::clamp(vol, 0, static_cast<int>(props_.volume_max));
+    cancel_volume_steps();
+    LOG_INFO("set volume: %d", vol);
+    double d = vol;
+    bool ok = set_property("volume", MPV_FORMAT_DOUBLE, &d);
+    if (ok && update(props_.volume, d)) ++props_.version;
+    return ok;
+}
+
+bool LibmpvPlayer::send_volume_step(int delta) {
+    std::string step = std::to_string(delta);
+    return command({"add", "volume", step.c_str()});
+}
+
+bool LibmpvPlayer::set_pause(bool pause) {
+    int flag = pause ? 1 : 0;
+    return set_property("pause", MPV_FORMAT_FLAG, &flag);
+}
+
+bool LibmpvPlayer::set_mute(bool mute, DoneCallback cb) {
+    int flag = mute ? 1 : 0;
+    return set_property("mute", MPV_FORMAT_FLAG, &flag, std::move(cb));
+}
+
+bool LibmpvPlayer::set_buffering(double cache_secs, double readahead_secs) {
+    return set_property("cache-secs", MPV_FORMAT_DOUBLE, &cache_secs) &&
+           set_property("demuxer-readahead-secs", MPV_FORMAT_DOUBLE, &readahead_secs);
+}
+
+void LibmpvPlayer::process_events() {
+    if (wakeup_fd_ < 0) return;
+    uint64_t n;
+    while (read(wakeup_fd_, &n, sizeof(n)) > 0) {}
+
+    // A callback may shut us down; re-check mpv_ every round.
+    while (mpv_) {
+        mpv_event* ev = mpv_wait_event(mpv_, 0);
+        if (ev->event_id == MPV_EVENT_NONE) break;
+        handle_event(*ev);
+    }
+}
+
+void LibmpvPlayer::handle_event(const mpv_event& ev) {
+    switch (ev.event_id) {
+    case MPV_EVENT_PROPERTY_CHANGE: {
+        int id = static_cast<int>(ev.reply_userdata);
+        auto* prop = static_cast<const mpv_event_property*>(ev.data);
+        bool changed = apply_property(id, *prop);
+        if (id == OBS_METADATA && meta_cb_) {
+            meta_cb_(props_.metadata_title);
+        } else if (id == OBS_PAUSE) {
+            telemetry_pause(props_.pause);
+            if (changed && pause_cb_) pause_cb_(props_.pause);
+        } else if (id == OBS_MUTE) {
+            telemetry_mute(props_.mute);
+        } else if (id == OBS_PAUSED_FOR_CACHE) {
+            telemetry_cache_pause(props_.paused_for_cache);
+        } else if (id == OBS_CACHE_DURATION) {
+            telemetry_cache_duration(props_.cache_duration);
+        } else if (id == OBS_VOLUME) {
+            volume_reported();
+        }
+        break;
+    }
+    case MPV_EVENT_COMMAND_REPLY:
+    case MPV_EVENT_SET_PROPERTY_REPLY: {
+        auto it = pending_.find(ev.reply_userdata);
+        if (it == pending_.end()) {
+            if (ev.error < 0) LOG_WARN("mpv request failed: %s", mpv_error_string(ev.error));
+            break;
+        }
+        DoneCallback cb = std::move(it->second);
+        pending_.erase(it);
+        if (cb) cb(ev.error >= 0);
+        break;
+    }
+    case MPV_EVENT_PLAYBACK_RESTART:
+        telemetry_playback_restart();
+        if (playback_cb_) playback_cb_();
+        break;
+    case MPV_EVENT_START_FILE:
+        playing_ = true;
+        telemetry_start_file();
+        break;
+    case MPV_EVENT_FILE_LOADED:
+        telemetry_file_loaded();
+        break;
+    case MPV_EVENT_END_FILE: {
+        auto* ef = static_cast<const mpv_event_end_file*>(ev.data);
+        if (ef->reason != MPV_END_FILE_REASON_STOP &&
+            ef->reason != MPV_END_FILE_REASON_REDIRECT) {
+            playing_ = false;
+            telemetry_end();
+        }
+        break;
+    }
+    case MPV_EVENT_SHUTDOWN:
+        // The core only quits on request; nothing in the daemon sends one.
+        LOG_ERROR("libmpv core shut down");
+        shutdown();
+        break;
+    default:
+        break;
+    }
+}
+
+bool LibmpvPlayer::apply_property(int id, const mpv_event_property& prop) {
+    bool changed = false;
+    bool none = prop.format == MPV_FORMAT_NONE || !prop.data;
+    auto as_flag = [&] { return !none && *static_cast<const int*>(prop.data) != 0; };
+    auto as_double = [&] { return none ? 0.0 : *static_cast<const double*>(prop.data); };
+    auto as_node = [&] { return none ? nullptr : static_cast<const mpv_node*>(prop.data); };
+
+    switch (id) {
+    case OBS_METADATA: {
+        const mpv_node* node = as_node();
+        const mpv_node* title = map_get(node, "icy-title");
+        if (!title || title->format != MPV_FORMAT_STRING) title = map_get(node, "title");
+        changed = update(props_.metadata_title, node_string(title));
+        break;
+    }
+    case OBS_PAUSE:
+        changed = update(props_.pause, as_flag());
+        break;
+    case OBS_VOLUME:
+        if (!none) changed = update(props_.volume, as_double());
+        break;
+    case OBS_MUTE:
+        changed = update(props_.mute, as_flag());
+        break;
+    case OBS_PAUSED_FOR_CACHE:
+        changed = update(props_.paused_for_cache, as_flag());
+        break;
+    case OBS_CACHE_BUFFERING:
+        changed = update(props_.cache_buffering,
+                         none ? 0 : static_cast<int>(*static_cast<const int64_t*>(prop.data)));
+        break;
+    case OBS_MEDIA_TITLE:
+        changed = update(props_.media_title,
+                         std::string(none ? "" : *static_cast<char* const*>(prop.data)));
+        break;
+    case OBS_IDLE_ACTIVE:
+        changed = update(props_.idle_active, none || as_flag());
+        break;
+    case OBS_CORE_IDLE:
+        changed = update(props_.core_idle, none || as_flag());
+        break;
+    case OBS_CACHE_DURATION:
+        changed = update(props_.cache_duration, as_double());
+        break;
+    case OBS_AUDIO_PARAMS: {
+        const mpv_node* node = as_node();
+        changed = update(props_.audio_params.format, node_string(map_get(node, "format"))) |
+                  update(props_.audio_params.samplerate, node_int(map_get(node, "samplerate"))) |
+                  update(props_.audio_params.channel_count, node_int(map_get(node, "channel-count")));
+        break;
+    }
+    case OBS_VOLUME_MAX:
+        if (!none && as_double() > 0) changed = update(props_.volume_max, as_double());
+        break;
+    default:
+        return false;
+    }
+
+    if (changed) ++props_.version;
+    return changed;
+}
+
+#endif // HAVE_LIBMPV
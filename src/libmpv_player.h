@@ -0,0 +1,56 @@
+#pragma once
+
+#include "player.h"
+#include <cstdint>
+#include <initializer_list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct mpv_handle;
+struct mpv_event;
+struct mpv_event_property;
+
+// Player backend that embeds libmpv. Commands are calls into the mpv core
+// running inside this process; events are drained from mpv's queue when its
+// wakeup eventfd fires. No child process and no JSON on the control path.
+// Only built with HAVE_LIBMPV.
+class LibmpvPlayer : public Player {
+public:
+    ~LibmpvPlayer() override;
+
+    const char* backend() const override { return "libmpv"; }
+    // extra_args use mpv's command-line spelling (--name=value, --no-name).
+    bool start(const std::vector<std::string>& extra_args = {}) override;
+    void shutdown() override;
+
+    bool play(const std::string& url) override;
+    bool stop() override;
+    bool toggle_pause() override;
+    bool set_pause(bool pause) override;
+    bool set_volume(int vol) override;
+    bool set_mute(bool mute, DoneCallback cb = nullptr) override;
+    bool set_buffering(double cache_secs, double readahead_secs) override;
+
+    int fd() const override { return wakeup_fd_; }
+    void process_events() override;
+
+protected:
+    bool send_volume_step(int delta) override;
+
+private:
+    // Asynchronous mpv calls; cb fires from process_events() with the result.
+    bool command(std::initializer_list<const char*> args, DoneCallback cb = nullptr);
+    bool set_property(const char* name, int format, void* data,
+                      DoneCallback cb = nullptr);
+    uint64_t track(DoneCallback cb);
+    void handle_event(const mpv_event& ev);
+    bool apply_property(int id, const mpv_event_property& prop);
+    static void wakeup(void* ctx);
+
+    mpv_handle* mpv_ = nullptr;
+    int wakeup_fd_ = -1;
+    uint64_t next_reply_id_ = 1;
+    // Reply id 0 means nobody is waiting.
+    std::unordered_map<uint64_t, DoneCallback> pending_;
+};
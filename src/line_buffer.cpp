@@ -0,0 +1,68 @@
+#include "line_buffer.h"
+#include "ipc_codec.h"
+#include <unistd.h>
+#include <cstdint>
+#include <algorithm>
+#include <cstring>
+
+LineBuffer::LineBuffer(size_t capacity, size_t max_capacity)
+    : buf_(capacity), max_capacity_(max_capacity) {}
+
+void LineBuffer::clear() {
+    head_ = tail_ = scan_ = 0;
+}
+
+void LineBuffer::make_room() {
+    if (head_ == tail_) {
+        clear();
+        return;
+    }
+    if (head_ > 0) {
+        std::memmove(buf_.data(), buf_.data() + head_, tail_ - head_);
+        tail_ -= head_;
+        scan_ -= head_;
+        head_ = 0;
+    }
+    // A single line larger than the buffer: grow rather than lose it.
+    if (tail_ == buf_.size() && buf_.size() < max_capacity_)
+        buf_.resize(std::min(buf_.size() * 2, max_capacity_));
+}
+
+ssize_t LineBuffer::fill(int fd) {
+    if (tail_ == buf_.size()) make_room();
+    if (tail_ == buf_.size()) {
+        // Still full at the size cap: drop the oversized partial line.
+        clear();
+    }
+    ssize_t n = read(fd, buf_.data() + tail_, buf_.size() - tail_);
+    if (n > 0) tail_ += static_cast<size_t>(n);
+    return n;
+}
+
+bool LineBuffer::next_line(std::string_view& line) {
+    const char* base = buf_.data();
+    auto* nl = static_cast<const char*>(
+        std::memchr(base + scan_, '\n', tail_ - scan_));
+    if (!nl) {
+        scan_ = tail_;
+        if (head_ == tail_) clear();
+        return false;
+    }
+    size_t end = static_cast<size_t>(nl - base);
+    line = std::string_view(base + head_, end - head_);
+    head_ = scan_ = end + 1;
+    return true;
+}
+
+int LineBuffer::next_frame(std::string_view& payload) {
+    if (tail_ - head_ < IPC_FRAME_HEADER) return 0;
+    auto* p = reinterpret_cast<const unsigned char*>(buf_.data() + head_);
+    size_t len = (size_t{p[0]} << 24) | (size_t{p[1]} << 16) |
+                 (size_t{p[2]} << 8) | size_t{p[3]};
+    if (len > max_capacity_ - IPC_FRAME_HEADER) return -1;
+    if (tail_ - head_ < IPC_FRAME_HEADER + len) return 0;
+    payload = std::string_view(buf_.data() + head_ + IPC_FRAME_HEADER, len);
+    head_ += IPC_FRAME_HEADER + len;
+    scan_ = head_;
+    return 1;
+}
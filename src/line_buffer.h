@@ -0,0 +1,38 @@
+#pragma once
+
+#include <string_view>
+#include <vector>
+#include <sys/types.h>
+
+// Receive buffer for newline-delimited streams. read() goes straight into
+// the free tail, complete lines are handed out as views into the buffer, and
+// the unconsumed partial line is moved back to the front only when the tail
+// runs out. Draining a burst is linear in its size. A stream that switches
+// to length-prefixed frames (see ipc_codec.h) is drained with next_frame()
+// from the same buffer, so nothing read ahead is lost at the switch.
+class LineBuffer {
+public:
+    explicit LineBuffer(size_t capacity = 16384, size_t max_capacity = 1 << 20);
+
+    // One read() into the free space. Returns its result (0 on EOF, -1 with
+    // errno set on error or EAGAIN).
+    ssize_t fill(int fd);
+
+    // Next complete line without its '\n'. The view stays valid until the
+    // next fill()/clear().
+    bool next_line(std::string_view& line);
+    // Next frame's payload: 1 if one is complete, 0 if more bytes are
+    // needed, -1 if its declared length can never fit.
+    int next_frame(std::string_view& payload);
+
+    void clear();
+
+private:
+    void make_room();
+
+    std::vector<char> buf_;
+    size_t max_capacity_;
+    size_t head_ = 0;  // first unconsumed byte
+    size_t tail_ = 0;  // one past the last valid byte
+    size_t scan_ = 0;  // bytes in [head_, scan_) are known to hold no '\n'
+};
@@ -1,6 +1,8 @@
 #include "config.h"
 #include "log.h"
+#ifndef RPIRADIO_CLI_ONLY
 #include "daemon.h"
+#endif
 #include "cli.h"
 #include <cstring>
 #include <iostream>
@@ -8,7 +10,9 @@
 static void usage(const char* prog) {
     std::cerr << "Usage: " << prog << " <command> [args...]\n"
               << "\nCommands:\n"
+#ifndef RPIRADIO_CLI_ONLY
               << "  daemon              Start the radio daemon\n"
+#endif
                << "  play [N]            Play station N (1-based) or resume\n"
                << "  stop                Stop playback\n"
                << "  toggle              Toggle play/pause\n"
@@ -16,8 +20,13 @@ static void usage(const char* prog) {
               << "  prev                Previous station\n"
               << "  volume <N|up|down>  Set or adjust volume\n"
               << "  list                List stations\n"
-              << "  status              Show current status\n"
-              << "  reload              Reload config and stations\n";
+              << "  status [--wait]     Show current status (or wait for the next change)\n"
+              << "  stats               Show per-station playback statistics\n"
+              << "  commands            Show per-command call counts and latencies\n"
+              << "  watch               Print state changes as they happen\n"
+              << "  reload              Reload config and stations\n"
+              << "  shell               Read commands interactively over one connection\n"
+              << "  batch <file|->      Run commands from a file (one per line) over one connection\n";
 }
 
 int main(int argc, char* argv[]) {
@@ -26,13 +35,13 @@ int main(int argc, char* argv[]) {
         return 1;
     }
 
-    const char* cmd = argv[1];
-
-    if (std::strcmp(cmd, "daemon") == 0) {
+#ifndef RPIRADIO_CLI_ONLY
+    if (std::strcmp(argv[1], "daemon") == 0) {
         Config cfg = config_load();
         log_init(cfg.log_level);
         return daemon_run(cfg);
     }
+#endif
 
     return cli_dispatch(DEFAULT_IPC_SOCKET_PATH, argc - 1, argv + 1);
 }
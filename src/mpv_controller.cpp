@@ -1,57 +1,122 @@
 #include "mpv_controller.h"
 #include "log.h"
+#include "mpv_message.h"
 #include <sys/socket.h>
-#include <sys/un.h>
+#include <sys/syscall.h>
 #include <sys/wait.h>
 #include <unistd.h>
 #include <signal.h>
 #include <fcntl.h>
 #include <poll.h>
 #include <cstring>
-#include <thread>
-#include <chrono>
-#include <sstream>
+#include <algorithm>
+
+namespace {
+
+// observe_property ids; mpv echoes them back in property-change events.
+struct ObservedProperty {
+    int id;
+    const char* name;
+};
+
+constexpr int STARTUP_TIMEOUT_MS = 5000;
+constexpr int RESPAWN_BASE_MS = 100;
+constexpr int RESPAWN_MAX_MS = 10000;
+
+enum : int {
+    OBS_METADATA = 1,
+    OBS_PAUSE,
+    OBS_VOLUME,
+    OBS_MEDIA_TITLE,
+    OBS_IDLE_ACTIVE,
+    OBS_CORE_IDLE,
+    OBS_CACHE_DURATION,
+    OBS_AUDIO_PARAMS,
+    OBS_VOLUME_MAX,
+    OBS_PAUSED_FOR_CACHE,
+    OBS_CACHE_BUFFERING,
+    OBS_MUTE,
+};
+
+constexpr ObservedProperty OBSERVED_PROPERTIES[] = {
+    {OBS_METADATA,       "metadata"},
+    {OBS_PAUSE,          "pause"},
+    {OBS_VOLUME,         "volume"},
+    {OBS_MEDIA_TITLE,    "media-title"},
+    {OBS_IDLE_ACTIVE,    "idle-active"},
+    {OBS_CORE_IDLE,      "core-idle"},
+    {OBS_CACHE_DURATION, "demuxer-cache-duration"},
+    {OBS_AUDIO_PARAMS,   "audio-params"},
+    {OBS_VOLUME_MAX,     "volume-max"},
+    {OBS_PAUSED_FOR_CACHE, "paused-for-cache"},
+    {OBS_CACHE_BUFFERING,  "cache-buffering-state"},
+    {OBS_MUTE,           "mute"},
+};
+
+template <typename T>
+bool update(T& field, const T& value) {
+    if (field == value) return false;
+    field = value;
+    return true;
+}
 
-bool MpvController::connect_socket(const std::string& path) {
-    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
-    if (fd < 0) return false;
+} // namespace
 
-    struct sockaddr_un addr{};
-    addr.sun_family = AF_UNIX;
-    std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+void MpvController::attach(int fd) {
+    sock_fd_ = fd;
+    rx_.clear();
 
-    if (connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0) {
-        close(fd);
-        return false;
+    int flags = fcntl(sock_fd_, F_GETFL, 0);
+    fcntl(sock_fd_, F_SETFL, flags | O_NONBLOCK);
+
+    // mpv answers each observe_property with an initial property-change,
+    // which seeds the cache.
+    for (auto& p : OBSERVED_PROPERTIES) {
+        send_command({{"command", {"observe_property", p.id, p.name}},
+                      {"request_id", 0}});
     }
+}
 
-    sock_fd_ = fd;
-    return true;
+bool MpvController::start(const std::vector<std::string>& extra_args) {
+    extra_args_ = extra_args;
+    return spawn(extra_args) && wait_ready(STARTUP_TIMEOUT_MS);
 }
 
-bool MpvController::start(const std::string& socket_path,
-                           const std::vector<std::string>& extra_args) {
-    socket_path_ = socket_path;
-    unlink(socket_path.c_str());
+bool MpvController::spawn(const std::vector<std::string>& extra_args) {
+    // mpv gets one end of a connected socketpair (--input-ipc-client), so
+    // there is no filesystem socket to wait for and nothing to poll.
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) < 0) {
+        LOG_ERROR("socketpair failed: %s", strerror(errno));
+        return false;
+    }
 
     int err_pipe[2];
-    if (pipe(err_pipe) < 0) {
+    if (pipe2(err_pipe, O_CLOEXEC) < 0) {
         LOG_ERROR("pipe failed: %s", strerror(errno));
+        close(sv[0]);
+        close(sv[1]);
         return false;
     }
 
+    spawn_time_ = std::chrono::steady_clock::now();
+    ready_ = false;
+    ready_ms_ = -1;
+
     pid_t pid = fork();
     if (pid < 0) {
         LOG_ERROR("fork failed: %s", strerror(errno));
+        close(sv[0]);
+        close(sv[1]);
         close(err_pipe[0]);
         close(err_pipe[1]);
         return false;
     }
 
     if (pid == 0) {
-        close(err_pipe[0]);
         dup2(err_pipe[1], STDERR_FILENO);
-        close(err_pipe[1]);
+        // Keep mpv's end of the socketpair open across exec.
+        fcntl(sv[1], F_SETFD, 0);
 
         // Reset signal mask so mpv can receive SIGTERM/SIGINT normally.
         // The parent daemon may have blocked signals before this fork,
@@ -61,8 +126,8 @@ bool MpvController::start(const std::string& socket_path,
         sigprocmask(SIG_SETMASK, &empty, nullptr);
 
         std::vector<std::string> args = {
-            "mpv", "--idle", "--no-video", "--no-terminal",
-            "--input-ipc-server=" + socket_path
+            binary_, "--idle", "--no-video", "--no-terminal",
+            "--input-ipc-client=fd://" + std::to_string(sv[1])
         };
         for (auto& a : extra_args) args.push_back(a);
 
@@ -70,98 +135,126 @@ bool MpvController::start(const std::string& socket_path,
         for (auto& a : args) argv.push_back(const_cast<char*>(a.c_str()));
         argv.push_back(nullptr);
 
-        execvp("mpv", argv.data());
+        execvp(binary_.c_str(), argv.data());
         _exit(127);
     }
 
+    close(sv[1]);
     close(err_pipe[1]);
     err_fd_ = err_pipe[0];
     fcntl(err_fd_, F_SETFL, fcntl(err_fd_, F_GETFL, 0) | O_NONBLOCK);
 
     mpv_pid_ = pid;
-    LOG_INFO("started mpv pid=%d socket=%s", pid, socket_path.c_str());
+    LOG_INFO("started mpv pid=%d", pid);
+
+    pid_fd_ = static_cast<int>(syscall(SYS_pidfd_open, pid, 0));
+    if (pid_fd_ < 0) {
+        LOG_WARN("pidfd_open: %s — mpv crash detection disabled", strerror(errno));
+    } else {
+        fcntl(pid_fd_, F_SETFD, FD_CLOEXEC);
+    }
 
-    for (int i = 0; i < 50; ++i) {
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    attach(sv[0]);
 
-        // Check if child already exited (e.g. mpv not found)
-        int status;
-        pid_t ret = waitpid(mpv_pid_, &status, WNOHANG);
-        if (ret > 0) {
-            // drain mpv stderr
-            {
-                char buf[2048];
-                std::string output;
-                ssize_t n;
-                while ((n = read(err_fd_, buf, sizeof(buf) - 1)) > 0) {
-                    buf[n] = '\0';
-                    output.append(buf, n);
-                }
-                close(err_fd_);
-                err_fd_ = -1;
-                while (!output.empty() && output.back() == '\n') output.pop_back();
-                if (!output.empty()) {
-                    LOG_ERROR("mpv stderr: %s", output.c_str());
-                }
-            }
-            if (WIFEXITED(status) && WEXITSTATUS(status) == 127) {
-                LOG_ERROR("mpv not found — is it installed? (apt install mpv)");
-            } else {
-                LOG_ERROR("mpv exited prematurely with status %d", status);
-            }
-            mpv_pid_ = -1;
-            return false;
+    // The first reply proves mpv has parsed its options and is serving IPC.
+    send_request({{"command", {"get_property", "mpv-version"}}},
+                 [this](const nlohmann::json& resp) {
+        if (resp.is_null()) {
+            // A respawned mpv that never answers is treated like a crash;
+            // handle_exit() picks it up through the pidfd.
+            if (recovering_ && mpv_pid_ > 0) kill(mpv_pid_, SIGTERM);
+            return;
         }
+        ready_ = true;
+        ready_ms_ = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - spawn_time_).count();
+        if (err_fd_ >= 0) { close(err_fd_); err_fd_ = -1; }
+        std::string version = resp.contains("data") && resp["data"].is_string()
+                                  ? resp["data"].get<std::string>() : "unknown";
+        LOG_INFO("mpv ready in %lld ms (%s)", static_cast<long long>(ready_ms_),
+                 version.c_str());
+        if (recovering_) finish_recovery();
+    }, STARTUP_TIMEOUT_MS);
+    return true;
+}
 
-        if (connect_socket(socket_path)) {
-            if (err_fd_ >= 0) { close(err_fd_); err_fd_ = -1; }
-            LOG_INFO("connected to mpv IPC socket");
+bool MpvController::wait_ready(int timeout_ms) {
+    auto deadline = std::chrono::steady_clock::now() +
+                    std::chrono::milliseconds(timeout_ms);
+    while (!ready_ && sock_fd_ >= 0) {
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+            deadline - std::chrono::steady_clock::now()).count();
+        if (ms <= 0) break;
+        struct pollfd pfd{};
+        pfd.fd = sock_fd_;
+        pfd.events = POLLIN;
+        if (poll(&pfd, 1, static_cast<int>(ms)) < 0 && errno != EINTR) break;
+        process_events();
+    }
+    if (ready_) return true;
 
-            int flags = fcntl(sock_fd_, F_GETFL, 0);
-            fcntl(sock_fd_, F_SETFL, flags | O_NONBLOCK);
+    bool exited = sock_fd_ < 0;
+    disconnect();
 
-            send_command({{"command", {"observe_property", 1, "metadata"}},
-                          {"request_id", 0}});
-            send_command({{"command", {"observe_property", 2, "pause"}},
-                          {"request_id", 0}});
-            return true;
-        }
-    }
+    std::string output = drain_stderr();
+    if (!output.empty()) LOG_ERROR("mpv stderr: %s", output.c_str());
 
-    // drain mpv stderr
-    {
-        char buf[2048];
-        std::string output;
-        ssize_t n;
-        while ((n = read(err_fd_, buf, sizeof(buf) - 1)) > 0) {
-            buf[n] = '\0';
-            output.append(buf, n);
-        }
-        close(err_fd_);
-        err_fd_ = -1;
-        while (!output.empty() && output.back() == '\n') output.pop_back();
-        if (!output.empty()) {
-            LOG_ERROR("mpv stderr: %s", output.c_str());
-        }
-    }
-    LOG_ERROR("timeout connecting to mpv IPC socket");
-    // Clean up the orphaned mpv child process
     if (mpv_pid_ > 0) {
-        kill(mpv_pid_, SIGTERM);
-        int status;
-        waitpid(mpv_pid_, &status, 0);
+        int status = 0;
+        if (!exited) {
+            LOG_ERROR("timeout waiting for mpv IPC");
+            kill(mpv_pid_, SIGTERM);
+            waitpid(mpv_pid_, &status, 0);
+        } else {
+            // The socket only hits EOF once mpv is exiting.
+            waitpid(mpv_pid_, &status, 0);
+            if (WIFEXITED(status) && WEXITSTATUS(status) == 127) {
+                LOG_ERROR("%s not found — is mpv installed? (apt install mpv)",
+                          binary_.c_str());
+            } else {
+                LOG_ERROR("mpv exited prematurely with status %d", status);
+            }
+        }
         mpv_pid_ = -1;
     }
+    if (pid_fd_ >= 0) { close(pid_fd_); pid_fd_ = -1; }
     return false;
 }
 
-void MpvController::shutdown() {
-    if (err_fd_ >= 0) { close(err_fd_); err_fd_ = -1; }
+std::string MpvController::drain_stderr() {
+    std::string output;
+    if (err_fd_ < 0) return output;
+    char buf[2048];
+    ssize_t n;
+    while ((n = read(err_fd_, buf, sizeof(buf))) > 0) {
+        output.append(buf, static_cast<size_t>(n));
+    }
+    close(err_fd_);
+    err_fd_ = -1;
+    while (!output.empty() && output.back() == '\n') output.pop_back();
+    return output;
+}
+
+void MpvController::disconnect() {
     if (sock_fd_ >= 0) {
-        send_command({{"command", {"quit"}}});
         close(sock_fd_);
         sock_fd_ = -1;
     }
+    rx_.clear();
+
+    // Fail whatever was still waiting; callbacks may issue new requests,
+    // which will fail immediately now that the socket is gone.
+    auto pending = std::move(pending_);
+    pending_.clear();
+    for (auto& [rid, req] : pending) {
+        if (req.cb) req.cb(nullptr);
+    }
+}
+
+void MpvController::shutdown() {
+    if (err_fd_ >= 0) { close(err_fd_); err_fd_ = -1; }
+    if (sock_fd_ >= 0) send_command({{"command", {"quit"}}});
+    disconnect();
     if (mpv_pid_ > 0) {
         int status;
         if (waitpid(mpv_pid_, &status, WNOHANG) == 0) {
@@ -170,168 +263,361 @@ void MpvController::shutdown() {
         }
         mpv_pid_ = -1;
     }
-    playing_ = false;
-    paused_ = false;
+    if (pid_fd_ >= 0) { close(pid_fd_); pid_fd_ = -1; }
+    respawn_pending_ = false;
+    recovering_ = false;
+    reset_state();
 }
 
 bool MpvController::send_command(const nlohmann::json& cmd) {
     if (sock_fd_ < 0) return false;
     std::string msg = cmd.dump() + "\n";
-    ssize_t n = write(sock_fd_, msg.c_str(), msg.size());
+    ssize_t n = send(sock_fd_, msg.c_str(), msg.size(), MSG_NOSIGNAL);
     return n == static_cast<ssize_t>(msg.size());
 }
 
-nlohmann::json MpvController::send_command_sync(const nlohmann::json& cmd, int request_id) {
+bool MpvController::send_request(const nlohmann::json& cmd, ReplyCallback cb,
+                                 int timeout_ms) {
+    int rid = next_req_id_++;
     nlohmann::json c = cmd;
-    c["request_id"] = request_id;
-    if (!send_command(c)) return nullptr;
-
-    int prev_flags = fcntl(sock_fd_, F_GETFL, 0);
-    fcntl(sock_fd_, F_SETFL, prev_flags & ~O_NONBLOCK);
+    c["request_id"] = rid;
+    if (!send_command(c)) {
+        if (cb) cb(nullptr);
+        return false;
+    }
+    pending_[rid] = {std::move(cb),
+                     std::chrono::steady_clock::now() +
+                         std::chrono::milliseconds(timeout_ms)};
+    return true;
+}
 
-    struct pollfd pfd{};
-    pfd.fd = sock_fd_;
-    pfd.events = POLLIN;
+Player::Clock::time_point MpvController::next_deadline() const {
+    auto earliest = Clock::time_point::max();
+    for (auto& [rid, req] : pending_) {
+        if (req.deadline < earliest) earliest = req.deadline;
+    }
+    if (respawn_pending_ && respawn_at_ < earliest) earliest = respawn_at_;
+    return earliest;
+}
 
-    std::string buf;
-    char tmp[4096];
-    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+void MpvController::backend_timeouts(Clock::time_point now) {
+    for (auto it = pending_.begin(); it != pending_.end();) {
+        if (it->second.deadline <= now) {
+            LOG_WARN("mpv request %d timed out", it->first);
+            ReplyCallback cb = std::move(it->second.cb);
+            it = pending_.erase(it);
+            if (cb) cb(nullptr);
+        } else {
+            ++it;
+        }
+    }
 
-    while (std::chrono::steady_clock::now() < deadline) {
-        int ms = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(
-            deadline - std::chrono::steady_clock::now()).count());
-        if (ms <= 0) break;
-        if (poll(&pfd, 1, ms) <= 0) break;
-
-        ssize_t n = read(sock_fd_, tmp, sizeof(tmp) - 1);
-        if (n <= 0) break;
-        buf.append(tmp, static_cast<size_t>(n));
-
-        size_t pos;
-        while ((pos = buf.find('\n')) != std::string::npos) {
-            std::string line = buf.substr(0, pos);
-            buf.erase(0, pos + 1);
-            try {
-                auto j = nlohmann::json::parse(line);
-                if (j.contains("request_id") && j["request_id"] == request_id) {
-                    fcntl(sock_fd_, F_SETFL, prev_flags);
-                    return j;
-                }
-            } catch (...) {}
+    if (respawn_pending_ && respawn_at_ <= now) {
+        respawn_pending_ = false;
+        LOG_INFO("respawning mpv (attempt %d)", restart_attempt_);
+        if (!spawn(extra_args_)) {
+            schedule_respawn();
+            return;
         }
+        if (respawn_cb_) respawn_cb_();
+    }
+}
+
+void MpvController::handle_exit() {
+    if (mpv_pid_ <= 0) return;
+    int status = 0;
+    if (waitpid(mpv_pid_, &status, WNOHANG) <= 0) return;
+
+    auto now = std::chrono::steady_clock::now();
+    close(pid_fd_);
+    pid_fd_ = -1;
+    mpv_pid_ = -1;
+
+    std::string output = drain_stderr();
+    if (!output.empty()) LOG_ERROR("mpv stderr: %s", output.c_str());
+    if (WIFSIGNALED(status))
+        LOG_ERROR("mpv killed by signal %d", WTERMSIG(status));
+    else
+        LOG_ERROR("mpv exited unexpectedly with status %d", WEXITSTATUS(status));
+
+    if (!recovering_) {
+        restore_ = {playing_, props_.pause, get_volume()};
+        crash_time_ = now;
+        recovering_ = true;
+    }
+    // A process that ran for a while before dying starts a fresh backoff
+    // sequence; one that dies straight after spawning keeps backing off.
+    if (now - spawn_time_ > std::chrono::seconds(30)) restart_attempt_ = 0;
+
+    disconnect();
+    awaiting_audio_ = false;
+    reset_state();
+
+    schedule_respawn();
+}
+
+void MpvController::schedule_respawn() {
+    int delay = std::min(RESPAWN_BASE_MS << std::min(restart_attempt_, 10),
+                         RESPAWN_MAX_MS);
+    ++restart_attempt_;
+    respawn_at_ = std::chrono::steady_clock::now() + std::chrono::milliseconds(delay);
+    respawn_pending_ = true;
+    LOG_WARN("mpv respawn in %d ms", delay);
+}
+
+void MpvController::finish_recovery() {
+    if (restore_.volume >= 0) set_volume(restore_.volume);
+    if (recovered_cb_) recovered_cb_(restore_.playing);
+    if (restore_.playing && restore_.paused) {
+        set_pause(true);
+        props_.pause = true;
     }
+    if (restore_.playing && !restore_.paused && playing_) {
+        // Dead air ends when mpv reports playback-restart for the reload.
+        awaiting_audio_ = true;
+    } else {
+        report_recovery();
+    }
+}
 
-    fcntl(sock_fd_, F_SETFL, prev_flags);
-    return nullptr;
+void MpvController::report_recovery() {
+    recovering_ = false;
+    awaiting_audio_ = false;
+    last_recovery_ms_ = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - crash_time_).count();
+    LOG_INFO("mpv recovered after %d attempt(s), %lld ms dead air",
+             restart_attempt_, static_cast<long long>(last_recovery_ms_));
 }
 
 bool MpvController::play(const std::string& url) {
     LOG_INFO("play: %s", url.c_str());
-    bool ok = send_command({{"command", {"loadfile", url, "replace"}}});
+    bool ok = set_pause(false) &&
+              send_command({{"command", {"loadfile", url, "replace"}}});
     if (ok) {
         playing_ = true;
-        paused_ = false;
+        telemetry_load(url);
     }
     return ok;
 }
 
 bool MpvController::stop() {
     LOG_INFO("stop");
-    bool ok = send_command({{"command", {"stop"}}});
+    bool ok = send_command({{"command", {"stop"}}}) && set_pause(false);
     if (ok) {
         playing_ = false;
-        paused_ = false;
+        telemetry_end();
     }
     return ok;
 }
 
 bool MpvController::toggle_pause() {
-    int rid = next_req_id_++;
-    auto resp = send_command_sync(
-        {{"command", {"cycle", "pause"}}}, rid);
-    if (resp.is_null()) {
-        LOG_WARN("toggle_pause: no response from mpv");
-        return false;
-    }
-    paused_ = !paused_;
-    LOG_INFO("pause toggled → %s", paused_ ? "paused" : "playing");
-    return true;
+    bool ok = send_request({{"command", {"cycle", "pause"}}},
+                           [](const nlohmann::json& resp) {
+        if (resp.is_null())
+            LOG_WARN("toggle_pause: no response from mpv");
+        else if (resp.value("error", "") != "success")
+            LOG_WARN("toggle_pause: %s", resp.value("error", "").c_str());
+    });
+    if (ok) LOG_INFO("pause toggle sent");
+    // The cache follows mpv's "pause" event, which also fires on_pause; a
+    // failed cycle then leaves it untouched.
+    return ok;
 }
 
-bool MpvController::set_volume(int vol) {
-    if (vol < 0) vol = 0;
-    if (vol > 150) vol = 150;
-    LOG_INFO("set volume: %d", vol);
-    return send_command({{"command", {"set_property", "volume", vol}}});
+bool MpvController::set_pause(bool pause) {
+    return send_command({{"command", {"set_property", "pause", pause}}});
 }
 
-int MpvController::get_volume() {
-    int rid = next_req_id_++;
-    auto resp = send_command_sync(
-        {{"command", {"get_property", "volume"}}}, rid);
-    if (!resp.is_null() && resp.contains("data"))
-        return resp["data"].get<int>();
-    return -1;
+bool MpvController::set_mute(bool mute, DoneCallback cb) {
+    return send_request({{"command", {"set_property", "mute", mute}}},
+                        [cb = std::move(cb)](const nlohmann::json& resp) {
+        if (cb) cb(!resp.is_null() && resp.value("error", "") == "success");
+    });
 }
 
-std::string MpvController::get_metadata() {
-    int rid = next_req_id_++;
-    auto resp = send_command_sync(
-        {{"command", {"get_property", "media-title"}}}, rid);
-    if (!resp.is_null() && resp.contains("data") && resp["data"].is_string())
-        return resp["data"].get<std::string>();
-    return "";
+bool MpvController::set_buffering(double cache_secs, double readahead_secs) {
+    // Both apply to the next loadfile, which is queued behind these.
+    return send_command({{"command", {"set_property", "cache-secs", cache_secs}}}) &&
+           send_command({{"command", {"set_property", "demuxer-readahead-secs",
+                                       readahead_secs}}});
+}
+
+bool MpvController::set_volume(int vol) {
+    vol = std::clamp(vol, 0, static_cast<int>(props_.volume_max));
+    // An absolute value supersedes any steps still waiting to be sent.
+    cancel_volume_steps();
+    LOG_INFO("set volume: %d", vol);
+    bool ok = send_request({{"command", {"set_property", "volume", vol}}},
+                           [](const nlohmann::json& resp) {
+        if (resp.is_null() || resp.value("error", "") != "success")
+            LOG_WARN("set_volume: mpv rejected the change");
+    });
+    // The observed "volume" property confirms; update now so back-to-back
+    // relative adjustments build on the value just requested.
+    if (ok && update(props_.volume, static_cast<double>(vol))) ++props_.version;
+    return ok;
+}
+
+bool MpvController::send_volume_step(int delta) {
+    return send_request({{"command", {"add", "volume", delta}}},
+                        [](const nlohmann::json& resp) {
+        if (resp.is_null() || resp.value("error", "") != "success")
+            LOG_WARN("adjust_volume: mpv rejected the change");
+    });
 }
 
 void MpvController::process_events() {
     if (sock_fd_ < 0) return;
 
-    char buf[8192];
-    static std::string remainder;
-
-    ssize_t n = read(sock_fd_, buf, sizeof(buf) - 1);
-    if (n <= 0) return;
-
-    remainder.append(buf, static_cast<size_t>(n));
-
-    size_t pos;
-    while ((pos = remainder.find('\n')) != std::string::npos) {
-        std::string line = remainder.substr(0, pos);
-        remainder.erase(0, pos + 1);
-
-        if (line.empty()) continue;
-        try {
-            auto j = nlohmann::json::parse(line);
-            if (!j.contains("event")) continue;
-
-            std::string event = j["event"];
-            if (event == "property-change") {
-                std::string name = j.value("name", "");
-                if (name == "metadata" && meta_cb_) {
-                    std::string title;
-                    if (j.contains("data") && j["data"].is_object()) {
-                        auto& d = j["data"];
-                        if (d.contains("icy-title"))
-                            title = d["icy-title"].get<std::string>();
-                        else if (d.contains("title"))
-                            title = d["title"].get<std::string>();
-                    }
-                    meta_cb_(title);
-                } else if (name == "pause" && pause_cb_) {
-                    bool p = j.value("data", false);
-                    paused_ = p;
-                    pause_cb_(p);
-                }
-            } else if (event == "start-file") {
-                playing_ = true;
-                paused_ = false;
-            } else if (event == "end-file") {
-                std::string reason = j.value("reason", "");
-                if (reason != "stop" && reason != "redirect") {
-                    playing_ = false;
-                    paused_ = false;
-                }
-            }
-        } catch (...) {}
+    ssize_t n = rx_.fill(sock_fd_);
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)) {
+        LOG_WARN("mpv IPC connection closed");
+        disconnect();
+        return;
+    }
+    if (n < 0) return;
+
+    std::string_view line;
+    while (rx_.next_line(line)) {
+        if (!line.empty()) handle_line(line);
+    }
+}
+
+void MpvController::handle_line(std::string_view line) {
+    MpvMessage msg;
+    if (!mpv_parse_message(line, msg)) return;
+
+    if (msg.event.empty()) {
+        // Command reply: route to whoever is waiting on this request_id.
+        // Only replies with a waiter are materialized into a json object.
+        auto it = pending_.find(static_cast<int>(msg.request_id));
+        if (it == pending_.end()) return;
+        ReplyCallback cb = std::move(it->second.cb);
+        pending_.erase(it);
+        nlohmann::json j = nlohmann::json::parse(line, nullptr, false);
+        if (cb) cb(j.is_discarded() ? nlohmann::json() : j);
+        return;
+    }
+
+    if (msg.event == "property-change") {
+        bool changed = apply_property(static_cast<int>(msg.id), msg.data);
+        if (msg.id == OBS_METADATA && meta_cb_) {
+            meta_cb_(props_.metadata_title);
+        } else if (msg.id == OBS_PAUSE) {
+            telemetry_pause(props_.pause);
+            if (changed && pause_cb_) pause_cb_(props_.pause);
+        } else if (msg.id == OBS_MUTE) {
+            telemetry_mute(props_.mute);
+        } else if (msg.id == OBS_PAUSED_FOR_CACHE) {
+            telemetry_cache_pause(props_.paused_for_cache);
+        } else if (msg.id == OBS_CACHE_DURATION) {
+            telemetry_cache_duration(props_.cache_duration);
+        } else if (msg.id == OBS_VOLUME) {
+            // Confirmations of an optimistic update are unchanged but still
+            // (re)start the settle timer.
+            volume_reported();
+        }
+    } else if (msg.event == "playback-restart") {
+        telemetry_playback_restart();
+        if (awaiting_audio_) report_recovery();
+        if (playback_cb_) playback_cb_();
+    } else if (msg.event == "start-file") {
+        playing_ = true;
+        telemetry_start_file();
+    } else if (msg.event == "file-loaded") {
+        telemetry_file_loaded();
+    } else if (msg.event == "end-file") {
+        if (msg.reason != "stop" && msg.reason != "redirect") {
+            playing_ = false;
+            telemetry_end();
+        }
+    }
+    // Anything else (audio-reconfig, seek, log-message, ...) is dropped
+    // without being decoded.
+}
+
+namespace {
+
+bool update_string(std::string& field, std::string_view raw) {
+    if (raw.size() >= 2 && raw.front() == '"' &&
+        raw.find('\\') == std::string_view::npos) {
+        std::string_view s = raw.substr(1, raw.size() - 2);
+        if (field == s) return false;
+        field.assign(s);
+        return true;
+    }
+    auto j = nlohmann::json::parse(raw, nullptr, false);
+    return update(field, j.is_string() ? j.get<std::string>() : std::string());
+}
+
+} // namespace
+
+bool MpvController::apply_property(int id, std::string_view raw) {
+    bool changed = false;
+    bool b = false;
+    double d = 0;
+
+    switch (id) {
+    case OBS_METADATA: {
+        std::string title;
+        auto j = nlohmann::json::parse(raw, nullptr, false);
+        if (j.is_object()) {
+            if (j.contains("icy-title") && j["icy-title"].is_string())
+                title = j["icy-title"].get<std::string>();
+            else if (j.contains("title") && j["title"].is_string())
+                title = j["title"].get<std::string>();
+        }
+        changed = update(props_.metadata_title, title);
+        break;
+    }
+    case OBS_PAUSE:
+        changed = update(props_.pause, mpv_value_bool(raw, b) && b);
+        break;
+    case OBS_VOLUME:
+        if (mpv_value_double(raw, d)) changed = update(props_.volume, d);
+        break;
+    case OBS_VOLUME_MAX:
+        if (mpv_value_double(raw, d) && d > 0) changed = update(props_.volume_max, d);
+        break;
+    case OBS_MUTE:
+        changed = update(props_.mute, mpv_value_bool(raw, b) && b);
+        break;
+    case OBS_PAUSED_FOR_CACHE:
+        changed = update(props_.paused_for_cache, mpv_value_bool(raw, b) && b);
+        break;
+    case OBS_CACHE_BUFFERING:
+        changed = update(props_.cache_buffering,
+                         mpv_value_double(raw, d) ? static_cast<int>(d) : 0);
+        break;
+    case OBS_MEDIA_TITLE:
+        changed = update_string(props_.media_title, raw);
+        break;
+    case OBS_IDLE_ACTIVE:
+        changed = update(props_.idle_active, !mpv_value_bool(raw, b) || b);
+        break;
+    case OBS_CORE_IDLE:
+        changed = update(props_.core_idle, !mpv_value_bool(raw, b) || b);
+        break;
+    case OBS_CACHE_DURATION:
+        changed = update(props_.cache_duration, mpv_value_double(raw, d) ? d : 0.0);
+        break;
+    case OBS_AUDIO_PARAMS: {
+        AudioParams ap;
+        auto j = nlohmann::json::parse(raw, nullptr, false);
+        if (j.is_object()) {
+            ap.format = j.value("format", "");
+            ap.samplerate = j.value("samplerate", 0);
+            ap.channel_count = j.value("channel-count", 0);
+        }
+        changed = update(props_.audio_params.format, ap.format) |
+                  update(props_.audio_params.samplerate, ap.samplerate) |
+                  update(props_.audio_params.channel_count, ap.channel_count);
+        break;
     }
+    default:
+        return false;
+    }
+
+    if (changed) ++props_.version;
+    return changed;
 }
@@ -1,47 +1,100 @@
 #pragma once
 
+#include "player.h"
+#include "line_buffer.h"
 #include <string>
 #include <functional>
+#include <chrono>
+#include <string_view>
+#include <unordered_map>
+#include <sys/types.h>
 #include <nlohmann/json.hpp>
 
-class MpvController {
+// Player backend that forks mpv and drives it over JSON IPC.
+class MpvController : public Player {
 public:
-    using MetadataCallback = std::function<void(const std::string& title)>;
-    using PauseCallback = std::function<void(bool paused)>;
+    // Invoked with mpv's reply object, or with null if the request timed out
+    // or could not be written.
+    using ReplyCallback = std::function<void(const nlohmann::json& reply)>;
 
-    bool start(const std::string& socket_path,
-               const std::vector<std::string>& extra_args = {});
-    void shutdown();
+    // binary is exec'd in place of mpv, e.g. bench/fake_mpv.
+    explicit MpvController(std::string binary = "mpv") : binary_(std::move(binary)) {}
 
-    bool play(const std::string& url);
-    bool stop();
-    bool toggle_pause();
-    bool set_volume(int vol);
-    int get_volume();
-    std::string get_metadata();
-    bool is_playing() const { return playing_; }
-    bool is_paused() const { return paused_; }
+    const char* backend() const override { return "ipc"; }
+    // Forks mpv on a private socketpair and waits for its first IPC reply.
+    bool start(const std::vector<std::string>& extra_args = {}) override;
+    void shutdown() override;
 
-    int fd() const { return sock_fd_; }
-    void process_events();
+    bool play(const std::string& url) override;
+    bool stop() override;
+    bool toggle_pause() override;
+    bool set_pause(bool pause) override;
+    bool set_volume(int vol) override;
+    bool set_mute(bool mute, DoneCallback cb = nullptr) override;
+    bool set_buffering(double cache_secs, double readahead_secs) override;
 
-    void on_metadata(MetadataCallback cb) { meta_cb_ = std::move(cb); }
-    void on_pause(PauseCallback cb) { pause_cb_ = std::move(cb); }
+    // Adopts an already-connected mpv IPC socket and subscribes to the
+    // observed properties. start() calls this once mpv is reachable.
+    void attach(int fd);
+    int fd() const override { return sock_fd_; }
+    void process_events() override;
+
+    // pidfd of the mpv child; becomes readable when mpv exits.
+    int pid_fd() const override { return pid_fd_; }
+    pid_t pid() const { return mpv_pid_; }
+    // Reaps a crashed mpv and schedules a respawn with exponential backoff.
+    void handle_exit() override;
+    int64_t last_recovery_ms() const override { return last_recovery_ms_; }
+
+protected:
+    bool send_volume_step(int delta) override;
+    // Earliest pending request deadline or respawn.
+    Clock::time_point next_deadline() const override;
+    void backend_timeouts(Clock::time_point now) override;
 
 private:
+    struct PendingRequest {
+        ReplyCallback cb;
+        std::chrono::steady_clock::time_point deadline;
+    };
+
     bool send_command(const nlohmann::json& cmd);
-    nlohmann::json send_command_sync(const nlohmann::json& cmd, int request_id);
-    void read_responses();
-    bool connect_socket(const std::string& path);
+    bool send_request(const nlohmann::json& cmd, ReplyCallback cb,
+                      int timeout_ms = 2000);
+    void handle_line(std::string_view line);
+    bool apply_property(int id, std::string_view raw);
+    bool spawn(const std::vector<std::string>& extra_args);
+    bool wait_ready(int timeout_ms);
+    std::string drain_stderr();
+    void disconnect();
+    void schedule_respawn();
+    void finish_recovery();
+    void report_recovery();
 
-    std::string socket_path_;
+    std::string binary_;
     int sock_fd_ = -1;
     int err_fd_ = -1;
+    int pid_fd_ = -1;
     pid_t mpv_pid_ = -1;
-    bool playing_ = false;
-    bool paused_ = false;
+    std::vector<std::string> extra_args_;
+    std::chrono::steady_clock::time_point spawn_time_;
     int next_req_id_ = 1;
+    LineBuffer rx_;
+    std::unordered_map<int, PendingRequest> pending_;
 
-    MetadataCallback meta_cb_;
-    PauseCallback pause_cb_;
+    // Supervisor state. restore_ is captured at the first crash of a
+    // recovery and reapplied once a replacement mpv is ready.
+    struct RestoreState {
+        bool playing = false;
+        bool paused = false;
+        int volume = -1;
+    };
+    bool recovering_ = false;
+    bool awaiting_audio_ = false;
+    RestoreState restore_;
+    int restart_attempt_ = 0;
+    std::chrono::steady_clock::time_point crash_time_;
+    std::chrono::steady_clock::time_point respawn_at_;
+    bool respawn_pending_ = false;
+    int64_t last_recovery_ms_ = -1;
 };
@@ -0,0 +1,118 @@
+#include "mpv_message.h"
+#include <charconv>
+
+namespace {
+
+void skip_ws(const char*& p, const char* end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')) ++p;
+}
+
+// p points at the opening quote; leaves p after the closing quote.
+bool skip_string(const char*& p, const char* end) {
+    for (++p; p < end; ++p) {
+        if (*p == '\\') {
+            ++p;
+        } else if (*p == '"') {
+            ++p;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool skip_value(const char*& p, const char* end) {
+    if (p >= end) return false;
+    if (*p == '"') return skip_string(p, end);
+    if (*p == '{' || *p == '[') {
+        int depth = 0;
+        while (p < end) {
+            char c = *p;
+            if (c == '"') {
+                if (!skip_string(p, end)) return false;
+                continue;
+            }
+            if (c == '{' || c == '[') ++depth;
+            else if (c == '}' || c == ']') --depth;
+            ++p;
+            if (depth == 0) return true;
+        }
+        return false;
+    }
+    // number, true, false, null
+    const char* start = p;
+    while (p < end && *p != ',' && *p != '}' && *p != ']' &&
+           *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n') ++p;
+    return p > start;
+}
+
+std::string_view unquote(std::string_view v) {
+    if (v.size() >= 2 && v.front() == '"' && v.back() == '"')
+        return v.substr(1, v.size() - 2);
+    return {};
+}
+
+int64_t to_int(std::string_view v) {
+    int64_t n = -1;
+    std::from_chars(v.data(), v.data() + v.size(), n);
+    return n;
+}
+
+} // namespace
+
+bool mpv_parse_message(std::string_view line, MpvMessage& msg) {
+    msg = MpvMessage{};
+    const char* p = line.data();
+    const char* end = p + line.size();
+
+    skip_ws(p, end);
+    if (p >= end || *p != '{') return false;
+    ++p;
+
+    while (true) {
+        skip_ws(p, end);
+        if (p >= end) return false;
+        if (*p == '}') return true;
+        if (*p != '"') return false;
+
+        const char* key_start = p + 1;
+        if (!skip_string(p, end)) return false;
+        std::string_view key(key_start, static_cast<size_t>(p - key_start - 1));
+
+        skip_ws(p, end);
+        if (p >= end || *p != ':') return false;
+        ++p;
+        skip_ws(p, end);
+
+        const char* val_start = p;
+        if (!skip_value(p, end)) return false;
+        std::string_view val(val_start, static_cast<size_t>(p - val_start));
+
+        if (key == "event")           msg.event = unquote(val);
+        else if (key == "name")       msg.name = unquote(val);
+        else if (key == "data")       msg.data = val;
+        else if (key == "request_id") msg.request_id = to_int(val);
+        else if (key == "id")         msg.id = to_int(val);
+        else if (key == "error")      msg.error = unquote(val);
+        else if (key == "reason")     msg.reason = unquote(val);
+
+        skip_ws(p, end);
+        if (p >= end) return false;
+        if (*p == ',') {
+            ++p;
+            continue;
+        }
+        if (*p == '}') return true;
+        return false;
+    }
+}
+
+bool mpv_value_bool(std::string_view raw, bool& out) {
+    if (raw == "true")  { out = true;  return true; }
+    if (raw == "false") { out = false; return true; }
+    return false;
+}
+
+bool mpv_value_double(std::string_view raw, double& out) {
+    auto r = std::from_chars(raw.data(), raw.data() + raw.size(), out);
+    return r.ec == std::errc() && r.ptr == raw.data() + raw.size();
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+// Top-level fields of one line from mpv's JSON IPC, as views into that line.
+// String members hold the raw text between the quotes; data holds the raw
+// JSON text of the value. Nothing is decoded or allocated until a caller
+// asks for a specific value.
+struct MpvMessage {
+    std::string_view event;
+    std::string_view name;
+    std::string_view reason;
+    std::string_view error;
+    std::string_view data;
+    int64_t request_id = -1;
+    int64_t id = -1;
+};
+
+// Scans a single JSON object without building a DOM. Returns false if the
+// line is not a well-formed object.
+bool mpv_parse_message(std::string_view line, MpvMessage& msg);
+
+// Typed readers for raw values taken from an MpvMessage.
+bool mpv_value_bool(std::string_view raw, bool& out);
+bool mpv_value_double(std::string_view raw, double& out);
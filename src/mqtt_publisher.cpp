@@ -1,13 +1,35 @@
 #include "mqtt_publisher.h"
 #include "log.h"
+#include <mqtt_protocol.h>
+#include <netdb.h>
+#include <sys/epoll.h>
+#include <algorithm>
+#include <cstdlib>
 #include <cstring>
 
-MqttPublisher::MqttPublisher() {
+// One getaddrinfo_a() request; the strings and hints must stay put until
+// glibc's resolver thread is done with them.
+struct MqttPublisher::Lookup {
+    std::string host;
+    struct addrinfo hints{};
+    struct gaicb req{};
+};
+
+MqttPublisher::MqttPublisher() : rng_(std::random_device{}()) {
     mosquitto_lib_init();
-    mosq_ = mosquitto_new("rpiradio", true, nullptr);
+    // No fixed client id: radios sharing a broker would take the session
+    // from each other on every reconnect. The clean session needs none.
+    mosq_ = mosquitto_new(nullptr, true, this);
     if (!mosq_) {
         LOG_ERROR("mosquitto_new failed");
+        return;
     }
+    // MQTT 5 for response topics and correlation data (mosquitto >= 1.6);
+    // brokers that refuse it get 3.1.1 (see connect_trampoline).
+    mosquitto_int_option(mosq_, MOSQ_OPT_PROTOCOL_VERSION, MQTT_PROTOCOL_V5);
+    mosquitto_connect_callback_set(mosq_, connect_trampoline);
+    mosquitto_disconnect_callback_set(mosq_, disconnect_trampoline);
+    mosquitto_message_v5_callback_set(mosq_, message_trampoline);
 }
 
 MqttPublisher::~MqttPublisher() {
@@ -21,43 +43,449 @@ MqttPublisher::~MqttPublisher() {
 
 bool MqttPublisher::connect(const std::string& host, int port) {
     if (!mosq_) return false;
+    host_ = host;
+    port_ = port;
+    attempts_ = 0;
+    start_attempt();
+    return true;
+}
+
+void MqttPublisher::disconnect() {
+    cancel_lookup();
+    State was = state_;
+    state_ = State::Idle;
+    if (mosq_ && was == State::Connected) {
+        mosquitto_disconnect(mosq_);
+        // Get the DISCONNECT (and anything still queued) out before the
+        // socket is closed.
+        mosquitto_loop_write(mosq_, 1);
+    }
+    unwatch();
+}
+
+// Each attempt looks the name up again, so a broker that moved is found.
+void MqttPublisher::start_attempt() {
+    cancel_lookup();
+    unwatch();
+
+    // Numeric addresses need no lookup.
+    struct addrinfo hints{};
+    hints.ai_flags = AI_NUMERICHOST;
+    struct addrinfo* res = nullptr;
+    if (getaddrinfo(host_.c_str(), nullptr, &hints, &res) == 0) {
+        freeaddrinfo(res);
+        connect_to(host_);
+        return;
+    }
+
+    lookup_ = std::make_unique<Lookup>();
+    lookup_->host = host_;
+    lookup_->hints.ai_family = AF_UNSPEC;
+    lookup_->hints.ai_socktype = SOCK_STREAM;
+    lookup_->hints.ai_flags = AI_ADDRCONFIG;
+    lookup_->req.ar_name = lookup_->host.c_str();
+    lookup_->req.ar_request = &lookup_->hints;
+    struct gaicb* list[] = {&lookup_->req};
+    int rc = getaddrinfo_a(GAI_NOWAIT, list, 1, nullptr);
+    if (rc != 0) {
+        lookup_.reset();
+        state_ = State::Connecting;    // so the failure schedules a retry
+        connection_lost(gai_strerror(rc));
+        return;
+    }
+    state_ = State::Resolving;
+    timer_at_ = Clock::now() + std::chrono::milliseconds(RESOLVE_POLL_MS);
+}
+
+void MqttPublisher::poll_lookup() {
+    int rc = gai_error(&lookup_->req);
+    if (rc == EAI_INPROGRESS) {
+        timer_at_ = Clock::now() + std::chrono::milliseconds(RESOLVE_POLL_MS);
+        return;
+    }
+
+    // Rotate through the addresses on successive failures, so a broker
+    // that only answers on one address family is still reached.
+    std::vector<std::string> addresses;
+    for (auto* ai = lookup_->req.ar_result; rc == 0 && ai; ai = ai->ai_next) {
+        char buf[NI_MAXHOST];
+        if (getnameinfo(ai->ai_addr, ai->ai_addrlen, buf, sizeof(buf),
+                        nullptr, 0, NI_NUMERICHOST) == 0)
+            addresses.emplace_back(buf);
+    }
+    if (lookup_->req.ar_result) freeaddrinfo(lookup_->req.ar_result);
+    lookup_.reset();
+
+    if (addresses.empty()) {
+        state_ = State::Connecting;
+        connection_lost(rc ? gai_strerror(rc) : "no usable address");
+        return;
+    }
+    connect_to(addresses[attempts_ % addresses.size()]);
+}
+
+void MqttPublisher::cancel_lookup() {
+    if (!lookup_) return;
+    int rc = gai_cancel(&lookup_->req);
+    if (rc == EAI_CANCELED || rc == EAI_ALLDONE) {
+        if (lookup_->req.ar_result) freeaddrinfo(lookup_->req.ar_result);
+        lookup_.reset();
+    } else {
+        // Still running in glibc's thread: it must keep its buffers.
+        lookup_.release();
+    }
+}
 
-    int rc = mosquitto_connect(mosq_, host.c_str(), port, 60);
+void MqttPublisher::connect_to(const std::string& address) {
+    state_ = State::Connecting;
+    LOG_DEBUG("MQTT connecting to %s (%s) port %d",
+              host_.c_str(), address.c_str(), port_);
+    int rc = mosquitto_connect_async(mosq_, address.c_str(), port_, 60);
     if (rc != MOSQ_ERR_SUCCESS) {
-        LOG_ERROR("MQTT connect to %s:%d failed: %s",
-                  host.c_str(), port, mosquitto_strerror(rc));
-        return false;
+        connection_lost(mosquitto_strerror(rc));
+        return;
+    }
+    auto now = Clock::now();
+    connect_deadline_ = now + std::chrono::milliseconds(CONNECT_TIMEOUT_MS);
+    timer_at_ = now + std::chrono::milliseconds(MISC_INTERVAL_MS);
+    update_watch();
+}
+
+void MqttPublisher::connect_trampoline(struct mosquitto*, void* obj, int rc) {
+    auto* self = static_cast<MqttPublisher*>(obj);
+    if (self->state_ != State::Connecting) return;
+    if ((rc == MQTT_RC_UNSUPPORTED_PROTOCOL_VERSION || rc == CONNACK_REFUSED_PROTOCOL_VERSION) &&
+        self->protocol_ == MQTT_PROTOCOL_V5) {
+        // Commands still get answers through a "response_topic" field.
+        LOG_INFO("MQTT broker %s:%d does not speak MQTT 5 — using 3.1.1",
+                 self->host_.c_str(), self->port_);
+        self->protocol_ = MQTT_PROTOCOL_V311;
+        mosquitto_int_option(self->mosq_, MOSQ_OPT_PROTOCOL_VERSION, MQTT_PROTOCOL_V311);
+        self->unwatch();
+        self->state_ = State::Backoff;
+        self->timer_at_ = Clock::now();
+        return;
+    }
+    if (rc != 0) {
+        self->connection_lost(mosquitto_connack_string(rc));
+        return;
+    }
+    self->state_ = State::Connected;
+    self->attempts_ = 0;
+    LOG_INFO("MQTT connected to %s:%d", self->host_.c_str(), self->port_);
+    // A fresh session may not have what the last one was sent, and anything
+    // still in flight when it dropped is gone: send every topic again.
+    for (auto& entry : self->topics_) entry.second.on_broker = false;
+    if (self->command_handler_) {
+        std::string filter = self->prefix_ + "/cmd/#";
+        int src = mosquitto_subscribe(self->mosq_, nullptr, filter.c_str(), 1);
+        if (src != MOSQ_ERR_SUCCESS)
+            LOG_WARN("MQTT subscribe to %s failed: %s", filter.c_str(), mosquitto_strerror(src));
+    }
+    if (self->connect_cb_) self->connect_cb_();
+    self->flush(true);
+}
+
+void MqttPublisher::disconnect_trampoline(struct mosquitto*, void* obj, int rc) {
+    auto* self = static_cast<MqttPublisher*>(obj);
+    self->connection_lost(rc ? mosquitto_strerror(rc) : "closed by broker");
+}
+
+void MqttPublisher::message_trampoline(struct mosquitto*, void* obj,
+                                       const struct mosquitto_message* msg,
+                                       const mosquitto_property* props) {
+    static_cast<MqttPublisher*>(obj)->handle_command(msg, props);
+}
+
+void MqttPublisher::handle_command(const struct mosquitto_message* msg,
+                                   const mosquitto_property* props) {
+    if (!command_handler_ || !msg->topic) return;
+    // A retained message is an old command, not someone pressing a button.
+    if (msg->retain) return;
+    std::string cmd_topic = prefix_ + "/cmd";
+    std::string topic = msg->topic;
+    if (topic.compare(0, cmd_topic.size(), cmd_topic) != 0) return;
+    std::string name;
+    if (topic.size() > cmd_topic.size()) {
+        if (topic[cmd_topic.size()] != '/') return;
+        name = topic.substr(cmd_topic.size() + 1);
+    }
+
+    // Payload: nothing, or the IPC request object (command optional when
+    // the topic names it).
+    auto* p = static_cast<const char*>(msg->payload);
+    nlohmann::json request = msg->payloadlen > 0
+        ? nlohmann::json::parse(p, p + msg->payloadlen, nullptr, false)
+        : nlohmann::json::object();
+
+    std::string reply_to;
+    char* prop_topic = nullptr;
+    if (mosquitto_property_read_string(props, MQTT_PROP_RESPONSE_TOPIC, &prop_topic, false)) {
+        reply_to = prop_topic;
+        std::free(prop_topic);
+    } else if (request.is_object() && request.contains("response_topic") &&
+               request["response_topic"].is_string()) {
+        reply_to = request["response_topic"].get<std::string>();
+    }
+    // Answering onto a command topic would run the answer as a command.
+    if (reply_to.compare(0, cmd_topic.size(), cmd_topic) == 0) {
+        LOG_WARN("MQTT command on %s: refusing response topic %s",
+                 topic.c_str(), reply_to.c_str());
+        reply_to.clear();
+    }
+
+    nlohmann::json response;
+    if (!request.is_object()) {
+        response = {{"status", "error"}, {"message", "invalid request"}};
+    } else {
+        if (!name.empty()) request["command"] = name;
+        LOG_DEBUG("MQTT request: %s", request.value("command", "").c_str());
+        response = command_handler_(request);
+        auto id = request.find("id");
+        if (id != request.end()) response["id"] = *id;
+    }
+    if (reply_to.empty() || state_ != State::Connected) return;
+
+    mosquitto_property* out = nullptr;
+    void* corr = nullptr;
+    uint16_t corr_len = 0;
+    if (mosquitto_property_read_binary(props, MQTT_PROP_CORRELATION_DATA, &corr, &corr_len, false)) {
+        mosquitto_property_add_binary(&out, MQTT_PROP_CORRELATION_DATA, corr, corr_len);
+        std::free(corr);
+    }
+    std::string payload = response.dump();
+    int rc = mosquitto_publish_v5(mosq_, nullptr, reply_to.c_str(),
+                                  static_cast<int>(payload.size()),
+                                  payload.c_str(), 1, false, out);
+    mosquitto_property_free_all(&out);
+    if (rc != MOSQ_ERR_SUCCESS) {
+        LOG_WARN("MQTT publish to %s failed: %s", reply_to.c_str(), mosquitto_strerror(rc));
+    }
+    update_watch();
+}
+
+void MqttPublisher::connection_lost(const char* why) {
+    // A failure reported both by a callback and by the return code of the
+    // loop call that ran it is handled once.
+    if (state_ != State::Connecting && state_ != State::Connected) return;
+    // Only the first of a run of failed attempts is worth a warning.
+    if (state_ == State::Connected) {
+        LOG_WARN("MQTT connection lost: %s", why);
+    } else if (attempts_ == 0) {
+        LOG_WARN("MQTT connect to %s:%d failed: %s — will keep retrying",
+                 host_.c_str(), port_, why);
+    } else {
+        LOG_DEBUG("MQTT connect to %s:%d failed: %s", host_.c_str(), port_, why);
     }
+    unwatch();
+    schedule_retry();
+}
+
+void MqttPublisher::schedule_retry() {
+    int step = RETRY_MIN_MS << std::min(attempts_, 6u);
+    step = std::min(step, RETRY_MAX_MS);
+    int delay = step / 2 + static_cast<int>(rng_() % static_cast<unsigned>(step / 2 + 1));
+    ++attempts_;
+    state_ = State::Backoff;
+    timer_at_ = Clock::now() + std::chrono::milliseconds(delay);
+    LOG_DEBUG("MQTT retry in %d ms", delay);
+}
+
+void MqttPublisher::on_watch(WatchCallback cb) {
+    watch_cb_ = std::move(cb);
+    watched_fd_ = -1;
+    watched_events_ = 0;
+    update_watch();
+}
 
-    connected_ = true;
-    LOG_INFO("MQTT connected to %s:%d", host.c_str(), port);
+void MqttPublisher::update_watch() {
+    bool live = state_ == State::Connecting || state_ == State::Connected;
+    int fd = mosq_ && live ? mosquitto_socket(mosq_) : -1;
+    uint32_t events = 0;
+    if (fd >= 0) events = EPOLLIN | (mosquitto_want_write(mosq_) ? uint32_t{EPOLLOUT} : 0u);
+    if (fd == watched_fd_ && events == watched_events_) return;
+    if (watch_cb_) {
+        if (watched_fd_ >= 0 && watched_fd_ != fd) watch_cb_(watched_fd_, 0);
+        if (fd >= 0) watch_cb_(fd, events);
+    }
+    watched_fd_ = fd;
+    watched_events_ = events;
+}
+
+void MqttPublisher::unwatch() {
+    if (watched_fd_ >= 0 && watch_cb_) watch_cb_(watched_fd_, 0);
+    watched_fd_ = -1;
+    watched_events_ = 0;
+}
+
+bool MqttPublisher::handle_fd(int fd, uint32_t events) {
+    if (fd < 0 || fd != watched_fd_) return false;
+    // A pending connect reports success or failure as writability.
+    int rc = MOSQ_ERR_SUCCESS;
+    if (events & (EPOLLIN | EPOLLHUP | EPOLLERR)) rc = mosquitto_loop_read(mosq_, 1);
+    if (rc == MOSQ_ERR_SUCCESS && (events & EPOLLOUT) && watched_fd_ >= 0)
+        rc = mosquitto_loop_write(mosq_, 1);
+    if (rc != MOSQ_ERR_SUCCESS) {
+        connection_lost(mosquitto_strerror(rc));
+        return true;
+    }
+    update_watch();
     return true;
 }
 
-void MqttPublisher::disconnect() {
-    if (mosq_ && connected_) {
-        mosquitto_disconnect(mosq_);
-        connected_ = false;
+int MqttPublisher::next_timeout_ms() const {
+    if (state_ == State::Idle) return -1;
+    auto at = timer_at_;
+    if (state_ == State::Connecting) at = std::min(at, connect_deadline_);
+    if (state_ == State::Connected) {
+        for (auto& entry : topics_) {
+            const Topic& t = entry.second;
+            if (!t.on_broker || t.sent != t.value) at = std::min(at, t.sent_at + t.interval);
+        }
+    }
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+        at - Clock::now()).count();
+    return static_cast<int>(std::max<int64_t>(0, ms));
+}
+
+void MqttPublisher::handle_timeouts() {
+    auto now = Clock::now();
+    switch (state_) {
+    case State::Idle:
+        return;
+    case State::Resolving:
+        if (now >= timer_at_) poll_lookup();
+        return;
+    case State::Backoff:
+        if (now >= timer_at_) start_attempt();
+        return;
+    case State::Connecting:
+        if (now >= connect_deadline_) {
+            connection_lost("timed out");
+            return;
+        }
+        break;
+    case State::Connected:
+        flush();
+        break;
+    }
+    if (now < timer_at_) return;
+    timer_at_ = now + std::chrono::milliseconds(MISC_INTERVAL_MS);
+    // Sends PINGREQ when the keepalive is due and notices a broker that
+    // stopped answering.
+    int rc = mosquitto_loop_misc(mosq_);
+    if (rc != MOSQ_ERR_SUCCESS) {
+        connection_lost(mosquitto_strerror(rc));
+        return;
     }
+    update_watch();
 }
 
 void MqttPublisher::pub(const std::string& subtopic, const std::string& payload) {
-    if (!mosq_ || !connected_) return;
+    auto it = topics_.find(subtopic);
+    if (it != topics_.end() && it->second.value == payload) return;
+    Topic& t = it == topics_.end() ? topic(subtopic) : it->second;
+    t.value = payload;
+    if (publish_cb_) publish_cb_(subtopic, payload);
+
+    if (state_ != State::Connected) return;
+    if (t.on_broker && t.sent == t.value) return;
+    if (Clock::now() - t.sent_at < t.interval) return;    // held for flush()
+    send(subtopic, t);
+    update_watch();
+}
+
+void MqttPublisher::flush(bool force) {
+    if (state_ != State::Connected) return;
+    auto now = Clock::now();
+    for (auto& [subtopic, t] : topics_) {
+        if (t.on_broker && t.sent == t.value) continue;
+        if (!force && now - t.sent_at < t.interval) continue;
+        if (!send(subtopic, t)) break;
+    }
+    update_watch();
+}
 
+bool MqttPublisher::send(const std::string& subtopic, Topic& t) {
     std::string topic = prefix_ + "/" + subtopic;
     int rc = mosquitto_publish(mosq_, nullptr, topic.c_str(),
-                               static_cast<int>(payload.size()),
-                               payload.c_str(), 1, true);
+                               static_cast<int>(t.value.size()),
+                               t.value.c_str(), 1, true);
     if (rc != MOSQ_ERR_SUCCESS) {
+        // Still differs from the broker's copy, so a flush one interval
+        // from now retries.
+        t.sent_at = Clock::now();
         LOG_WARN("MQTT publish to %s failed: %s",
                  topic.c_str(), mosquitto_strerror(rc));
-    } else {
-        LOG_DEBUG("MQTT publish %s: %s", topic.c_str(), payload.c_str());
+        return false;
     }
+    LOG_DEBUG("MQTT publish %s: %s", topic.c_str(), t.value.c_str());
+    t.sent = t.value;
+    t.on_broker = true;
+    t.sent_at = Clock::now();
+    return true;
 }
 
-void MqttPublisher::publish_state(const std::string& state) {
-    pub("state", state);
+MqttPublisher::Topic& MqttPublisher::topic(const std::string& subtopic) {
+    auto [it, added] = topics_.try_emplace(subtopic);
+    if (added) {
+        auto o = intervals_.find(subtopic);
+        it->second.interval = o != intervals_.end() ? o->second : min_interval_;
+    }
+    return it->second;
+}
+
+void MqttPublisher::set_min_interval(const std::string& subtopic, int ms) {
+    intervals_[subtopic] = std::chrono::milliseconds(ms);
+    auto it = topics_.find(subtopic);
+    if (it != topics_.end()) it->second.interval = intervals_[subtopic];
+}
+
+// RFC 7386 merge patch that turns `from` into `to`: changed members with
+// their new value (objects recursively), removed ones as null.
+static nlohmann::json merge_diff(const nlohmann::json& from, const nlohmann::json& to) {
+    if (!from.is_object() || !to.is_object()) return to;
+    nlohmann::json patch = nlohmann::json::object();
+    for (auto& [key, value] : from.items()) {
+        if (!to.contains(key)) patch[key] = nullptr;
+    }
+    for (auto& [key, value] : to.items()) {
+        auto old = from.find(key);
+        if (old == from.end()) {
+            patch[key] = value;
+        } else if (*old != value) {
+            patch[key] = merge_diff(*old, value);
+        }
+    }
+    return patch;
+}
+
+void MqttPublisher::publish_state(const nlohmann::json& state) {
+    if (state == model_) return;
+    nlohmann::json delta = merge_diff(model_, state);
+    model_ = state;
+    delta["seq"] = ++seq_;
+
+    // Deltas only mean something to a subscriber that saw the ones before,
+    // so they are neither retained nor kept while disconnected: a gap in seq
+    // tells a consumer to start over from state.
+    if (state_ == State::Connected) {
+        std::string topic = prefix_ + "/state/delta";
+        std::string payload = delta.dump();
+        int rc = mosquitto_publish(mosq_, nullptr, topic.c_str(),
+                                   static_cast<int>(payload.size()),
+                                   payload.c_str(), 1, false);
+        if (rc != MOSQ_ERR_SUCCESS) {
+            LOG_WARN("MQTT publish to %s failed: %s",
+                     topic.c_str(), mosquitto_strerror(rc));
+        } else {
+            LOG_DEBUG("MQTT publish %s: %s", topic.c_str(), payload.c_str());
+        }
+    }
+
+    nlohmann::json full = model_;
+    full["seq"] = seq_;
+    pub("state", full.dump());
 }
 
 void MqttPublisher::publish_station(const std::string& json_str) {
@@ -1,27 +1,169 @@
 #pragma once
 
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <random>
 #include <string>
+#include <unordered_map>
+#include <vector>
 #include <mosquitto.h>
+#include <nlohmann/json.hpp>
 
+// Publishes the radio's state to the broker. libmosquitto's network loop
+// runs on the daemon's event loop: the broker socket is handed out through
+// on_watch() (EPOLLOUT only while libmosquitto has output queued), and
+// handle_fd() / handle_timeouts() do the reading, writing and keepalive.
+//
+// Nothing here blocks: the broker name is resolved with getaddrinfo_a(),
+// the TCP connect and CONNACK complete on the event loop, and a failed or
+// lost connection is retried with jittered exponential backoff.
+//
+// Every topic is retained, so only its latest value matters: each topic
+// keeps its newest payload and the one the broker last accepted. A payload
+// equal to the newest is dropped; one arriving within the topic's minimum
+// interval of the previous send waits and goes out when the interval ends
+// (newer values replace it). While disconnected nothing is sent, and after
+// every CONNACK each topic's newest value is sent again.
+//
+// The state object is kept here as the canonical model, numbered by `seq`.
+// Each change goes out at once as an RFC 7386 merge patch on state/delta
+// (not retained, never held back or replayed), while the full object on
+// state follows at its own, slower interval.
+//
+// Commands come in the other way: requests published on {prefix}/cmd/<name>
+// (or {prefix}/cmd with "command" in the payload) go to on_command(), and
+// the answer is published to the request's MQTT 5 response topic with its
+// correlation data, or to the "response_topic" named in the payload.
 class MqttPublisher {
 public:
+    // Sees every change of a topic's value (topic without prefix), whether
+    // or not the broker is connected.
+    using PublishCallback =
+        std::function<void(const std::string& subtopic, const std::string& payload)>;
+    // Asks the owner to watch fd for events, or to stop when events is 0.
+    using WatchCallback = std::function<void(int fd, uint32_t events)>;
+    // The broker accepted a connection (the first one or a reconnect).
+    using ConnectCallback = std::function<void()>;
+    // Runs a request in the IPC form ({"command", "args", ...}) and returns
+    // the response.
+    using CommandHandler = std::function<nlohmann::json(const nlohmann::json& request)>;
+
+    // How often keepalive and retry bookkeeping (mosquitto_loop_misc) runs.
+    static constexpr int MISC_INTERVAL_MS = 1000;
+    // How often a pending name lookup is checked.
+    static constexpr int RESOLVE_POLL_MS = 20;
+    // From starting the TCP connect to CONNACK.
+    static constexpr int CONNECT_TIMEOUT_MS = 10000;
+    // Reconnect delays double from MIN to MAX; each is drawn from the upper
+    // half of the current step so a fleet does not retry in lockstep.
+    static constexpr int RETRY_MIN_MS = 1000;
+    static constexpr int RETRY_MAX_MS = 60000;
+    static constexpr int DEFAULT_MIN_INTERVAL_MS = 250;
+    static constexpr int DEFAULT_STATE_INTERVAL_MS = 5000;
+
     MqttPublisher();
     ~MqttPublisher();
 
+    // Starts connecting in the background and keeps reconnecting until
+    // disconnect(). False only if the client could not be created.
     bool connect(const std::string& host, int port);
     void disconnect();
+    bool connected() const { return state_ == State::Connected; }
 
-    void publish_state(const std::string& state);
+    // Takes the whole state; publishes the delta when it changed.
+    void publish_state(const nlohmann::json& state);
     void publish_station(const std::string& json_str);
     void publish_metadata(const std::string& title);
     void publish_volume(int vol);
 
     void set_prefix(const std::string& prefix) { prefix_ = prefix; }
+    // Least time between two sends on one topic: the default for all of
+    // them, and one topic's own.
+    void set_min_interval(int ms) { min_interval_ = std::chrono::milliseconds(ms); }
+    void set_min_interval(const std::string& subtopic, int ms);
+    void on_publish(PublishCallback cb) { publish_cb_ = std::move(cb); }
+    // Also reports the socket of a connection made before the call.
+    void on_watch(WatchCallback cb);
+    void on_connect(ConnectCallback cb) { connect_cb_ = std::move(cb); }
+    // Subscribes to {prefix}/cmd/# on every connect once set.
+    void on_command(CommandHandler handler) { command_handler_ = std::move(handler); }
+
+    // Services the broker socket; false if fd is not it.
+    bool handle_fd(int fd, uint32_t events);
+    // Milliseconds until the next lookup poll, retry, connect timeout,
+    // held publish or loop_misc; -1 when not connecting at all.
+    int next_timeout_ms() const;
+    void handle_timeouts();
 
 private:
+    using Clock = std::chrono::steady_clock;
+
+    enum class State {
+        Idle,       // not connecting (no connect() yet, or disconnected)
+        Resolving,  // waiting for getaddrinfo_a()
+        Connecting, // TCP connect / CONNECT sent, waiting for CONNACK
+        Connected,
+        Backoff,    // waiting to retry
+    };
+
+    struct Lookup;
+
+    struct Topic {
+        std::string value;          // newest payload
+        std::string sent;           // what the broker last accepted
+        bool on_broker = false;     // sent is valid for this connection
+        Clock::time_point sent_at;
+        Clock::duration interval{};
+    };
+
     void pub(const std::string& subtopic, const std::string& payload);
+    // Sends every topic that differs from the broker's copy and whose
+    // interval has passed (all of them when force is set).
+    void flush(bool force = false);
+    bool send(const std::string& subtopic, Topic& t);
+    Topic& topic(const std::string& subtopic);
+    // Watches the current socket for what libmosquitto needs right now.
+    void update_watch();
+    // Stops watching the socket before libmosquitto closes or replaces it.
+    void unwatch();
+
+    void start_attempt();
+    void poll_lookup();
+    void cancel_lookup();
+    void connect_to(const std::string& address);
+    void connection_lost(const char* why);
+    void schedule_retry();
+
+    static void connect_trampoline(struct mosquitto*, void* obj, int rc);
+    static void disconnect_trampoline(struct mosquitto*, void* obj, int rc);
+    static void message_trampoline(struct mosquitto*, void* obj,
+                                   const struct mosquitto_message* msg,
+                                   const mosquitto_property* props);
+    void handle_command(const struct mosquitto_message* msg,
+                        const mosquitto_property* props);
 
     struct mosquitto* mosq_ = nullptr;
     std::string prefix_ = "rpiradio";
-    bool connected_ = false;
+    Clock::duration min_interval_ = std::chrono::milliseconds(DEFAULT_MIN_INTERVAL_MS);
+    std::unordered_map<std::string, Topic> topics_;
+    std::unordered_map<std::string, Clock::duration> intervals_;   // overrides
+    nlohmann::json model_;      // canonical state, without seq
+    uint64_t seq_ = 0;
+    std::string host_;
+    int port_ = 0;
+    State state_ = State::Idle;
+    std::unique_ptr<Lookup> lookup_;
+    unsigned attempts_ = 0;     // failures since the last CONNACK
+    int protocol_ = MQTT_PROTOCOL_V5;
+    std::minstd_rand rng_;
+    PublishCallback publish_cb_;
+    WatchCallback watch_cb_;
+    ConnectCallback connect_cb_;
+    CommandHandler command_handler_;
+    int watched_fd_ = -1;
+    uint32_t watched_events_ = 0;
+    Clock::time_point timer_at_;        // lookup poll, retry or loop_misc
+    Clock::time_point connect_deadline_;
 };
@@ -0,0 +1,237 @@
+#include "player.h"
+#include "log.h"
+#include "mpv_controller.h"
+#ifdef HAVE_LIBMPV
+#include "libmpv_player.h"
+#endif
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// A volume step waits this long for followers before it is sent, but never
+// more than VOLUME_MAX_DELAY_MS after the first step of a burst.
+constexpr int VOLUME_COALESCE_MS = 40;
+constexpr int VOLUME_MAX_DELAY_MS = 150;
+// Quiet time after the last volume change before on_volume fires.
+constexpr int VOLUME_SETTLE_MS = 250;
+
+} // namespace
+
+std::unique_ptr<Player> make_player(const std::string& backend,
+                                    const std::string& mpv_binary) {
+    if (backend == "libmpv") {
+#ifdef HAVE_LIBMPV
+        return std::make_unique<LibmpvPlayer>();
+#else
+        LOG_WARN("built without libmpv — using the ipc player backend");
+#endif
+    } else if (backend != "ipc") {
+        LOG_WARN("unknown player backend '%s' — using ipc", backend.c_str());
+    }
+    return std::make_unique<MpvController>(mpv_binary);
+}
+
+int Player::get_volume() const {
+    if (props_.volume < 0) return -1;
+    // mpv clamps "add volume" to [0, volume-max]; predict the same.
+    double v = std::clamp(props_.volume + volume_delta_, 0.0, props_.volume_max);
+    return static_cast<int>(std::lround(v));
+}
+
+bool Player::adjust_volume(int delta) {
+    if (!ready_) return false;
+    auto now = Clock::now();
+    if (!volume_flush_pending_) {
+        volume_flush_pending_ = true;
+        volume_burst_start_ = now;
+    }
+    // Clamp after every step, as mpv would for steps sent one at a time:
+    // down past 0 and then up lands above 0, not back at 0.
+    if (props_.volume >= 0) {
+        double target = std::clamp(props_.volume + volume_delta_ + delta,
+                                   0.0, props_.volume_max);
+        volume_delta_ = static_cast<int>(std::lround(target - props_.volume));
+    } else {
+        volume_delta_ += delta;
+    }
+    volume_flush_at_ = std::min(now + std::chrono::milliseconds(VOLUME_COALESCE_MS),
+                                volume_burst_start_ +
+                                    std::chrono::milliseconds(VOLUME_MAX_DELAY_MS));
+    return true;
+}
+
+void Player::flush_volume() {
+    volume_flush_pending_ = false;
+    int delta = volume_delta_;
+    if (delta == 0) return;
+    int target = get_volume();
+    volume_delta_ = 0;
+
+    LOG_INFO("adjust volume: %+d", delta);
+    // Keep reporting the predicted value until mpv's property-change lands.
+    if (send_volume_step(delta) && target >= 0 &&
+        props_.volume != static_cast<double>(target)) {
+        props_.volume = target;
+        ++props_.version;
+    }
+}
+
+void Player::cancel_volume_steps() {
+    volume_delta_ = 0;
+    volume_flush_pending_ = false;
+}
+
+void Player::volume_reported() {
+    volume_settling_ = true;
+    volume_settle_at_ = Clock::now() + std::chrono::milliseconds(VOLUME_SETTLE_MS);
+}
+
+void Player::reset_state() {
+    telemetry_end();
+    cancel_volume_steps();
+    volume_settling_ = false;
+    ready_ = false;
+    playing_ = false;
+    uint64_t version = props_.version + 1;
+    props_ = MpvProperties{};
+    props_.version = version;
+}
+
+int Player::next_timeout_ms() const {
+    auto earliest = next_deadline();
+    if (volume_flush_pending_ && volume_flush_at_ < earliest)
+        earliest = volume_flush_at_;
+    if (volume_settling_ && volume_settle_at_ < earliest)
+        earliest = volume_settle_at_;
+    if (earliest == Clock::time_point::max()) return -1;
+
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+        earliest - Clock::now()).count();
+    return ms > 0 ? static_cast<int>(ms) + 1 : 0;
+}
+
+void Player::handle_timeouts() {
+    auto now = Clock::now();
+    if (volume_flush_pending_ && volume_flush_at_ <= now) flush_volume();
+    if (volume_settling_ && volume_settle_at_ <= now && !volume_flush_pending_) {
+        volume_settling_ = false;
+        if (volume_cb_) volume_cb_(get_volume());
+    }
+    backend_timeouts(now);
+}
+
+int64_t Player::since(Clock::time_point t, Clock::time_point now) const {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(now - t).count();
+}
+
+void Player::emit_telemetry(TelemetryEvent ev) {
+    if (telemetry_cb_) telemetry_cb_(ev, session_);
+}
+
+bool Player::counting_played() const {
+    return session_active_ && session_.first_audio_ms >= 0 && !stalled_ &&
+           !user_paused_ && !muted_;
+}
+
+PlaybackTelemetry Player::telemetry() const {
+    if (!session_active_) return {};
+    auto now = Clock::now();
+    PlaybackTelemetry t = session_;
+    if (counting_played()) t.played_ms += since(audio_since_, now);
+    if (stalled_) t.stalled_ms += since(stall_since_, now);
+    return t;
+}
+
+void Player::telemetry_load(const std::string& url) {
+    telemetry_end();
+    session_ = PlaybackTelemetry{};
+    session_.url = url;
+    session_active_ = true;
+    load_at_ = Clock::now();
+    stalled_ = false;
+    user_paused_ = false;
+}
+
+void Player::telemetry_start_file() {
+    if (session_active_ && session_.start_file_ms < 0)
+        session_.start_file_ms = since(load_at_, Clock::now());
+}
+
+void Player::telemetry_file_loaded() {
+    if (session_active_ && session_.file_loaded_ms < 0)
+        session_.file_loaded_ms = since(load_at_, Clock::now());
+}
+
+void Player::telemetry_playback_restart() {
+    if (!session_active_ || session_.first_audio_ms >= 0) return;
+    auto now = Clock::now();
+    session_.first_audio_ms = since(load_at_, now);
+    audio_since_ = now;
+    emit_telemetry(TelemetryEvent::FirstAudio);
+}
+
+void Player::telemetry_pause(bool paused) {
+    if (paused == user_paused_) return;
+    auto now = Clock::now();
+    if (counting_played()) session_.played_ms += since(audio_since_, now);
+    user_paused_ = paused;
+    if (counting_played()) audio_since_ = now;
+}
+
+void Player::telemetry_mute(bool muted) {
+    if (muted == muted_) return;
+    auto now = Clock::now();
+    if (counting_played()) session_.played_ms += since(audio_since_, now);
+    muted_ = muted;
+    if (counting_played()) audio_since_ = now;
+}
+
+void Player::telemetry_cache_pause(bool paused) {
+    // Filling the cache before the first audio is part of time-to-first-audio,
+    // not a stall; nobody hears a muted instance stall.
+    if (!session_active_ || session_.first_audio_ms < 0 || paused == stalled_) return;
+    if (paused && muted_) return;
+    auto now = Clock::now();
+    if (paused) {
+        if (counting_played()) session_.played_ms += since(audio_since_, now);
+        stalled_ = true;
+        stall_since_ = now;
+        return;
+    }
+    stalled_ = false;
+    session_.last_stall_ms = since(stall_since_, now);
+    session_.stalled_ms += session_.last_stall_ms;
+    ++session_.stalls;
+    if (counting_played()) audio_since_ = now;
+    LOG_DEBUG("stall on %s: %lld ms", session_.url.c_str(),
+              static_cast<long long>(session_.last_stall_ms));
+    emit_telemetry(TelemetryEvent::Stall);
+}
+
+void Player::telemetry_cache_duration(double secs) {
+    // The cache is still filling right after first audio; only the level it
+    // sinks to later says how close the stream came to stalling.
+    constexpr int64_t CACHE_SETTLE_MS = 5000;
+    if (!counting_played()) return;
+    if (since(audio_since_, Clock::now()) < CACHE_SETTLE_MS &&
+        session_.played_ms < CACHE_SETTLE_MS) return;
+    if (session_.min_cache_s < 0 || secs < session_.min_cache_s)
+        session_.min_cache_s = secs;
+}
+
+void Player::telemetry_end() {
+    if (!session_active_) return;
+    auto now = Clock::now();
+    if (stalled_) {
+        // Ended mid-stall, typically because the stream died.
+        session_.last_stall_ms = since(stall_since_, now);
+        session_.stalled_ms += session_.last_stall_ms;
+        ++session_.stalls;
+    } else if (counting_played()) {
+        session_.played_ms += since(audio_since_, now);
+    }
+    session_active_ = false;
+    stalled_ = false;
+    emit_telemetry(TelemetryEvent::End);
+}
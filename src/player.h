@@ -0,0 +1,213 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct AudioParams {
+    std::string format;
+    int samplerate = 0;
+    int channel_count = 0;
+};
+
+// Last values reported by mpv for the observed properties. Updated only from
+// property-change events; version is bumped whenever any field changes.
+struct MpvProperties {
+    bool pause = false;
+    bool mute = false;
+    double volume = -1;
+    double volume_max = 130;
+    std::string media_title;
+    std::string metadata_title;
+    bool idle_active = true;
+    bool core_idle = true;
+    double cache_duration = 0;
+    bool paused_for_cache = false;
+    // Cache fill towards resuming (0-100) while paused_for_cache.
+    int cache_buffering = 0;
+    AudioParams audio_params;
+    uint64_t version = 0;
+};
+
+// Timeline of one loadfile. Times are milliseconds since the loadfile was
+// sent; -1 until the corresponding mpv event arrives.
+struct PlaybackTelemetry {
+    std::string url;
+    int64_t start_file_ms = -1;
+    int64_t file_loaded_ms = -1;
+    int64_t first_audio_ms = -1;    // first playback-restart
+    int stalls = 0;                 // paused-for-cache after first audio, unmuted
+    int64_t stalled_ms = 0;
+    int64_t last_stall_ms = 0;
+    int64_t played_ms = 0;          // audible time: excludes stalls, pause and mute
+    // Lowest demuxer-cache-duration seen while audible, once the cache had a
+    // few seconds to fill after first audio; -1 if never sampled.
+    double min_cache_s = -1;
+};
+
+enum class TelemetryEvent {
+    FirstAudio,     // first_audio_ms was just set
+    Stall,          // a stall ended; see last_stall_ms
+    End,            // the load was replaced, stopped, failed or mpv died
+};
+
+// Playback backend. Both implementations drive mpv: MpvController talks JSON
+// IPC to a forked mpv, LibmpvPlayer embeds libmpv in-process. Getters are
+// served from the observed-property cache, and everything asynchronous is
+// delivered through process_events() when fd() becomes readable.
+class Player {
+public:
+    using Clock = std::chrono::steady_clock;
+    using MetadataCallback = std::function<void(const std::string& title)>;
+    using PauseCallback = std::function<void(bool paused)>;
+    using VolumeCallback = std::function<void(int volume)>;
+    using PlaybackCallback = std::function<void()>;
+    using RespawnCallback = std::function<void()>;
+    using RecoveredCallback = std::function<void(bool was_playing)>;
+    // Invoked once mpv has answered (ok = applied) or the request failed.
+    using DoneCallback = std::function<void(bool ok)>;
+    using TelemetryCallback =
+        std::function<void(TelemetryEvent ev, const PlaybackTelemetry& t)>;
+
+    virtual ~Player() = default;
+
+    virtual const char* backend() const = 0;
+    virtual bool start(const std::vector<std::string>& extra_args = {}) = 0;
+    virtual void shutdown() = 0;
+    bool is_ready() const { return ready_; }
+    // Milliseconds from start to mpv being able to take commands, -1 until ready.
+    int64_t ready_ms() const { return ready_ms_; }
+
+    virtual bool play(const std::string& url) = 0;
+    virtual bool stop() = 0;
+    virtual bool toggle_pause() = 0;
+    // mpv keeps pause across loadfile and stop; the cached value follows
+    // its property-change event.
+    virtual bool set_pause(bool pause) = 0;
+    virtual bool set_volume(int vol) = 0;
+    // Relative step, sent as mpv's "add volume" without reading the current
+    // value first. Steps arriving in quick succession are merged into one
+    // command; get_volume() already includes them.
+    bool adjust_volume(int delta);
+    virtual bool set_mute(bool mute, DoneCallback cb = nullptr) = 0;
+    // Network buffering (mpv's cache-secs / demuxer-readahead-secs) for the
+    // next load onwards.
+    virtual bool set_buffering(double cache_secs, double readahead_secs) = 0;
+
+    // Volume including steps not yet sent to mpv, -1 if unknown.
+    int get_volume() const;
+    std::string get_metadata() const { return props_.media_title; }
+    bool is_playing() const { return playing_; }
+    bool is_paused() const { return props_.pause; }
+    bool is_idle() const { return props_.idle_active; }
+    double cache_duration() const { return props_.cache_duration; }
+    const AudioParams& audio_params() const { return props_.audio_params; }
+    const MpvProperties& properties() const { return props_; }
+    // The current load's timeline, with played/stalled time counted up to
+    // now. Empty url if nothing is loaded.
+    PlaybackTelemetry telemetry() const;
+
+    // Readable whenever process_events() has work to do.
+    virtual int fd() const = 0;
+    virtual void process_events() = 0;
+
+    // Child-process supervision; in-process backends have no child.
+    virtual int pid_fd() const { return -1; }
+    virtual void handle_exit() {}
+    // Dead air of the most recent crash recovery, -1 if none yet.
+    virtual int64_t last_recovery_ms() const { return -1; }
+
+    // Milliseconds until the earliest scheduled work, or -1 if nothing is
+    // scheduled. Suitable as an epoll_wait() timeout.
+    int next_timeout_ms() const;
+    void handle_timeouts();
+
+    void on_metadata(MetadataCallback cb) { meta_cb_ = std::move(cb); }
+    void on_pause(PauseCallback cb) { pause_cb_ = std::move(cb); }
+    // Fired once mpv's volume has stopped changing, with the settled value.
+    void on_volume(VolumeCallback cb) { volume_cb_ = std::move(cb); }
+    // Fired on mpv's playback-restart, i.e. when audio starts flowing.
+    void on_playback(PlaybackCallback cb) { playback_cb_ = std::move(cb); }
+    // Fired right after a replacement mpv is forked: fd() and pid_fd() have
+    // changed and must be watched again.
+    void on_respawn(RespawnCallback cb) { respawn_cb_ = std::move(cb); }
+    // Fired once the replacement is ready and volume has been restored. The
+    // owner reloads the station if was_playing; pause is reapplied after.
+    void on_recovered(RecoveredCallback cb) { recovered_cb_ = std::move(cb); }
+    void on_telemetry(TelemetryCallback cb) { telemetry_cb_ = std::move(cb); }
+
+protected:
+    // Sends one merged relative volume step.
+    virtual bool send_volume_step(int delta) = 0;
+    // Earliest backend deadline, Clock::time_point::max() if none.
+    virtual Clock::time_point next_deadline() const { return Clock::time_point::max(); }
+    virtual void backend_timeouts(Clock::time_point now) { (void)now; }
+
+    // Backends call this for every volume report from mpv, changed or not.
+    void volume_reported();
+    // Drops unsent steps, e.g. when an absolute volume supersedes them.
+    void cancel_volume_steps();
+    // Forgets everything mpv told us; used when the mpv instance goes away.
+    void reset_state();
+
+    // Playback timeline; backends call these as the matching command is
+    // sent or mpv event / property change arrives.
+    void telemetry_load(const std::string& url);
+    void telemetry_start_file();
+    void telemetry_file_loaded();
+    void telemetry_playback_restart();
+    void telemetry_pause(bool paused);
+    void telemetry_mute(bool muted);
+    void telemetry_cache_pause(bool paused);
+    void telemetry_cache_duration(double secs);
+    void telemetry_end();
+
+    MpvProperties props_;
+    bool playing_ = false;
+    bool ready_ = false;
+    int64_t ready_ms_ = -1;
+
+    MetadataCallback meta_cb_;
+    PauseCallback pause_cb_;
+    VolumeCallback volume_cb_;
+    PlaybackCallback playback_cb_;
+    RespawnCallback respawn_cb_;
+    RecoveredCallback recovered_cb_;
+    TelemetryCallback telemetry_cb_;
+
+private:
+    void flush_volume();
+    int64_t since(Clock::time_point t, Clock::time_point now) const;
+    void emit_telemetry(TelemetryEvent ev);
+    bool counting_played() const;
+
+    // Volume steps not yet sent, and the pending "settled" notification.
+    int volume_delta_ = 0;
+    bool volume_flush_pending_ = false;
+    Clock::time_point volume_burst_start_;
+    Clock::time_point volume_flush_at_;
+    bool volume_settling_ = false;
+    Clock::time_point volume_settle_at_;
+
+    // Current load. audio_since_ marks the start of the span being counted
+    // as played; a stall, a pause or mute interrupts it.
+    PlaybackTelemetry session_;
+    bool session_active_ = false;
+    Clock::time_point load_at_;
+    Clock::time_point audio_since_;
+    Clock::time_point stall_since_;
+    bool stalled_ = false;
+    bool user_paused_ = false;
+    bool muted_ = false;
+};
+
+using PlayerFactory = std::function<std::unique_ptr<Player>()>;
+
+// Creates the backend named in the config ("ipc" or "libmpv"). Falls back to
+// "ipc" if the name is unknown or libmpv support was not compiled in. The
+// ipc backend runs mpv_binary (looked up in PATH unless it has a slash).
+std::unique_ptr<Player> make_player(const std::string& backend,
+                                    const std::string& mpv_binary = "mpv");
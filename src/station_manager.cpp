@@ -84,6 +84,13 @@ const Station* StationManager::prev() {
     return &stations_[static_cast<size_t>(current_)];
 }
 
+const Station* StationManager::peek(int offset) const {
+    if (stations_.empty() || current_ < 0) return nullptr;
+    int n = count();
+    int index = ((current_ + offset) % n + n) % n;
+    return &stations_[static_cast<size_t>(index)];
+}
+
 bool StationManager::select(int index) {
     if (index < 0 || index >= count()) return false;
     current_ = index;
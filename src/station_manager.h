@@ -16,6 +16,9 @@ public:
     const Station* current() const;
     const Station* next();
     const Station* prev();
+    // Station offset positions away from the current one (wrapping),
+    // without changing the selection.
+    const Station* peek(int offset) const;
     bool select(int index);
     int current_index() const { return current_; }
     int count() const { return static_cast<int>(stations_.size()); }
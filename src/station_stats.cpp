@@ -0,0 +1,119 @@
+#include "station_stats.h"
+#include <algorithm>
+#include <vector>
+
+using json = nlohmann::json;
+
+void StationStats::Samples::push(int64_t ms) {
+    v[count % WINDOW] = static_cast<int32_t>(std::min<int64_t>(ms, INT32_MAX));
+    ++count;
+}
+
+json StationStats::Samples::summary() const {
+    size_t n = std::min<size_t>(count, WINDOW);
+    if (n == 0) return nullptr;
+    std::array<int32_t, WINDOW> sorted = v;
+    std::sort(sorted.begin(), sorted.begin() + static_cast<long>(n));
+    auto pct = [&](double p) {
+        return sorted[std::min(n - 1, static_cast<size_t>(p * static_cast<double>(n)))];
+    };
+    return {{"p50", pct(0.50)}, {"p95", pct(0.95)}, {"p99", pct(0.99)},
+            {"max", sorted[n - 1]}, {"samples", n}};
+}
+
+StationStats::Entry* StationStats::find(const std::string& url) {
+    for (auto& e : entries_) {
+        if (e.last_used && e.url == url) return &e;
+    }
+    return nullptr;
+}
+
+const StationStats::Entry* StationStats::find(const std::string& url) const {
+    return const_cast<StationStats*>(this)->find(url);
+}
+
+StationStats::Entry& StationStats::touch(const std::string& url) {
+    Entry* e = find(url);
+    if (!e) {
+        e = &*std::min_element(entries_.begin(), entries_.end(),
+                               [](const Entry& a, const Entry& b) {
+            return a.last_used < b.last_used;
+        });
+        *e = Entry{};
+        e->url = url;
+    }
+    e->last_used = ++clock_;
+    return *e;
+}
+
+void StationStats::record(TelemetryEvent ev, const PlaybackTelemetry& t) {
+    if (t.url.empty()) return;
+    Entry& e = touch(t.url);
+    switch (ev) {
+    case TelemetryEvent::FirstAudio:
+        ++e.plays;
+        e.ttfa.push(t.first_audio_ms);
+        e.last = t;
+        break;
+    case TelemetryEvent::Stall:
+        e.stall.push(t.last_stall_ms);
+        break;
+    case TelemetryEvent::End:
+        if (t.first_audio_ms < 0) {
+            ++e.no_audio;
+            e.last = t;
+        }
+        e.stalls += static_cast<uint32_t>(t.stalls);
+        e.stalled_ms += t.stalled_ms;
+        e.played_ms += t.played_ms;
+        break;
+    }
+}
+
+void StationStats::record_warm_switch(const std::string& url, int64_t ms) {
+    if (url.empty()) return;
+    Entry& e = touch(url);
+    ++e.plays;
+    ++e.warm;
+    e.ttfa.push(ms);
+}
+
+json StationStats::to_json(const PlaybackTelemetry& live) const {
+    std::vector<const Entry*> used;
+    for (auto& e : entries_) {
+        if (e.last_used) used.push_back(&e);
+    }
+    std::sort(used.begin(), used.end(), [](const Entry* a, const Entry* b) {
+        return a->last_used > b->last_used;
+    });
+
+    json arr = json::array();
+    for (const Entry* e : used) {
+        uint32_t stalls = e->stalls;
+        int64_t played = e->played_ms;
+        int64_t stalled = e->stalled_ms;
+        if (!live.url.empty() && live.url == e->url) {
+            stalls += static_cast<uint32_t>(live.stalls);
+            played += live.played_ms;
+            stalled += live.stalled_ms;
+        }
+        double ratio = played + stalled > 0
+            ? static_cast<double>(stalled) / static_cast<double>(played + stalled)
+            : 0.0;
+
+        json last = {{"start_file_ms", e->last.start_file_ms},
+                     {"file_loaded_ms", e->last.file_loaded_ms},
+                     {"first_audio_ms", e->last.first_audio_ms}};
+        arr.push_back({{"url", e->url},
+                       {"plays", e->plays},
+                       {"warm_switches", e->warm},
+                       {"no_audio", e->no_audio},
+                       {"ttfa_ms", e->ttfa.summary()},
+                       {"last_load", last},
+                       {"stalls", stalls},
+                       {"stall_ms", e->stall.summary()},
+                       {"played_s", played / 1000},
+                       {"rebuffer_ratio", ratio}});
+    }
+    return arr;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "player.h"
+#include <array>
+#include <cstdint>
+#include <string>
+#include <nlohmann/json.hpp>
+
+// Rolling per-station playback statistics: time-to-first-audio, stalls and
+// rebuffer ratio. Footprint is fixed: at most MAX_STATIONS entries (the least
+// recently used one is recycled) and the last WINDOW samples per histogram.
+class StationStats {
+public:
+    static constexpr size_t MAX_STATIONS = 64;
+    static constexpr size_t WINDOW = 128;
+
+    // Feeds a player telemetry event. FirstAudio and Stall should only come
+    // from the audible instance; End from any (muted time is not counted).
+    void record(TelemetryEvent ev, const PlaybackTelemetry& t);
+    // A zap served by the pre-buffered standby: play → unmute ack.
+    void record_warm_switch(const std::string& url, int64_t ms);
+
+    // One object per station, most recently used first. live, if it has a
+    // url, is folded into its station's stall and played totals.
+    nlohmann::json to_json(const PlaybackTelemetry& live) const;
+
+private:
+    // Last WINDOW samples in a ring.
+    struct Samples {
+        std::array<int32_t, WINDOW> v{};
+        uint32_t count = 0;    // total ever pushed
+
+        void push(int64_t ms);
+        nlohmann::json summary() const;
+    };
+
+    struct Entry {
+        std::string url;
+        uint64_t last_used = 0;
+        uint32_t plays = 0;        // loads that produced audio
+        uint32_t no_audio = 0;     // loads that ended before any audio
+        uint32_t warm = 0;
+        uint32_t stalls = 0;
+        int64_t stalled_ms = 0;
+        int64_t played_ms = 0;
+        Samples ttfa;
+        Samples stall;
+        PlaybackTelemetry last;    // most recent cold load's timeline
+    };
+
+    Entry* find(const std::string& url);
+    const Entry* find(const std::string& url) const;
+    Entry& touch(const std::string& url);
+
+    std::array<Entry, MAX_STATIONS> entries_;
+    uint64_t clock_ = 0;
+};
@@ -0,0 +1,174 @@
+#include "station_switcher.h"
+#include "log.h"
+#include <algorithm>
+
+// The ALSA device named in mpv's arguments if it is one that only a single
+// process can open (a raw hw/hdmi device rather than dmix, default, pulse
+// or pipewire); "" otherwise.
+static std::string exclusive_alsa_device(const std::vector<std::string>& args) {
+    static const std::string opt = "--audio-device=alsa/";
+    for (auto& a : args) {
+        if (a.compare(0, opt.size(), opt) != 0) continue;
+        std::string dev = a.substr(opt.size());
+        for (const char* shared : {"dmix", "default", "pulse", "pipewire"}) {
+            if (dev.find(shared) != std::string::npos) return "";
+        }
+        return dev;
+    }
+    return "";
+}
+
+bool StationSwitcher::start(const PlayerFactory& make,
+                            const std::vector<std::string>& extra_args,
+                            bool standby) {
+    primary_ = make();
+    active_ = primary_.get();
+    wire(*primary_);
+    LOG_INFO("player backend: %s", primary_->backend());
+    if (!primary_->start(extra_args)) return false;
+    if (!standby) return true;
+
+    // The standby opens the same output as the active instance, muted,
+    // which a device only one process can open would refuse.
+    std::string dev = exclusive_alsa_device(extra_args);
+    if (!dev.empty()) {
+        LOG_WARN("zap_standby: ALSA device %s cannot be shared — zapping disabled; "
+                 "use a dmix, pulse or pipewire device",
+                 dev.c_str());
+        return true;
+    }
+
+    secondary_ = make();
+    wire(*secondary_);
+    std::vector<std::string> args = extra_args;
+    args.push_back("--mute=yes");
+    if (!secondary_->start(args)) {
+        LOG_WARN("standby mpv failed to start — zapping disabled");
+        secondary_->shutdown();
+        secondary_.reset();
+        return true;
+    }
+    standby_ = secondary_.get();
+    LOG_INFO("zapping enabled: standby mpv ready");
+    return true;
+}
+
+void StationSwitcher::shutdown() {
+    for (Player* mpv : instances()) {
+        if (mpv) mpv->shutdown();
+    }
+    standby_ = nullptr;
+    standby_url_.clear();
+}
+
+void StationSwitcher::wire(Player& mpv) {
+    mpv.on_respawn([this, &mpv] {
+        if (respawn_cb_) respawn_cb_(mpv);
+    });
+    mpv.on_recovered([this, &mpv](bool was_playing) {
+        if (is_active(mpv)) {
+            // A respawned ex-standby would come back muted.
+            mpv.set_mute(false);
+            if (was_playing && recovered_cb_) recovered_cb_(mpv);
+        } else {
+            // The standby lost whatever it had buffered.
+            std::string url = std::move(standby_url_);
+            standby_url_.clear();
+            prepare(url);
+        }
+    });
+    mpv.on_playback([this, &mpv] {
+        if (switch_pending_ && is_active(mpv)) switch_done(false);
+    });
+}
+
+void StationSwitcher::switch_done(bool warm) {
+    switch_pending_ = false;
+    last_switch_ms_ = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - switch_start_).count();
+    LOG_INFO("station switch (%s): %lld ms", warm ? "warm" : "cold",
+             static_cast<long long>(last_switch_ms_));
+    if (switched_cb_) switched_cb_(switch_url_, last_switch_ms_, warm);
+}
+
+void StationSwitcher::play(const std::string& url) {
+    switch_start_ = std::chrono::steady_clock::now();
+    switch_pending_ = true;
+    switch_url_ = url;
+
+    if (standby_ && !standby_url_.empty() && standby_url_ == url &&
+        standby_->is_ready()) {
+        Player* previous = active_;
+        active_ = standby_;
+        standby_ = previous;
+        standby_url_.clear();
+
+        int vol = previous->get_volume();
+        if (vol >= 0) active_->set_volume(vol);
+        // mpv keeps pause across loads; the standby must not come in paused.
+        active_->set_pause(false);
+        active_->set_mute(false, [this](bool ok) {
+            if (switch_pending_ && ok) switch_done(true);
+        });
+        // The old station stays buffered but silent until prepare()
+        // retargets it.
+        previous->set_mute(true);
+        return;
+    }
+
+    load(*active_, url);
+}
+
+void StationSwitcher::stop() {
+    switch_pending_ = false;
+    active_->stop();
+    prepare("");
+}
+
+void StationSwitcher::prepare(const std::string& url) {
+    if (!standby_ || url == standby_url_) return;
+    if (!standby_->is_ready()) return;
+    standby_url_ = url;
+    if (url.empty()) {
+        standby_->stop();
+        return;
+    }
+    LOG_DEBUG("standby pre-buffering %s", url.c_str());
+    standby_->set_mute(true);
+    // Player::play() also unpauses, so the standby buffers for real.
+    load(*standby_, url);
+}
+
+void StationSwitcher::load(Player& mpv, const std::string& url) {
+    if (load_cb_) load_cb_(mpv, url);
+    mpv.play(url);
+}
+
+bool StationSwitcher::handle_fd(int fd) {
+    for (Player* mpv : instances()) {
+        if (!mpv) continue;
+        if (fd == mpv->fd()) {
+            mpv->process_events();
+            return true;
+        }
+        if (fd == mpv->pid_fd()) {
+            mpv->handle_exit();
+            return true;
+        }
+    }
+    return false;
+}
+
+int StationSwitcher::next_timeout_ms() const {
+    int a = primary_ ? primary_->next_timeout_ms() : -1;
+    int b = secondary_ ? secondary_->next_timeout_ms() : -1;
+    if (a < 0) return b;
+    if (b < 0) return a;
+    return std::min(a, b);
+}
+
+void StationSwitcher::handle_timeouts() {
+    for (Player* mpv : instances()) {
+        if (mpv) mpv->handle_timeouts();
+    }
+}
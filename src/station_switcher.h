@@ -0,0 +1,80 @@
+#pragma once
+
+#include "player.h"
+#include <array>
+#include <memory>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Owns the player instance that is playing and, when zapping is enabled, a
+// second muted instance that pre-buffers the station most likely to be
+// picked next. Switching to the station the standby already holds swaps the
+// two instead of loading from cold.
+class StationSwitcher {
+public:
+    using InstanceCallback = std::function<void(Player& mpv)>;
+    using LoadCallback = std::function<void(Player& mpv, const std::string& url)>;
+    using SwitchCallback =
+        std::function<void(const std::string& url, int64_t ms, bool warm)>;
+
+    // Creates the active player (and the standby, if enabled) with make.
+    bool start(const PlayerFactory& make,
+               const std::vector<std::string>& extra_args, bool standby);
+    void shutdown();
+
+    Player& active() { return *active_; }
+    const Player& active() const { return *active_; }
+    bool is_active(const Player& mpv) const { return &mpv == active_; }
+    bool has_standby() const { return standby_ != nullptr; }
+    // Both slots; the second is null unless zapping is enabled.
+    std::array<Player*, 2> instances() { return {primary_.get(), secondary_.get()}; }
+
+    // Plays url on the active instance, swapping in the standby if it
+    // already has url buffered.
+    void play(const std::string& url);
+    void stop();
+    // Loads url into the active instance again, e.g. after it crashed;
+    // unlike play(), not timed as a switch.
+    void reload(const std::string& url) { load(*active_, url); }
+    // Points the standby at url; an empty url idles it.
+    void prepare(const std::string& url);
+    // Milliseconds from the most recent play() to audible output, -1 if unknown.
+    int64_t last_switch_ms() const { return last_switch_ms_; }
+
+    // Routes an epoll event to the owning instance; false if fd is not ours.
+    bool handle_fd(int fd);
+    int next_timeout_ms() const;
+    void handle_timeouts();
+
+    // Called with an instance whose fds changed after a respawn.
+    void on_respawn(InstanceCallback cb) { respawn_cb_ = std::move(cb); }
+    // Called when the active instance recovered from a crash and needs its
+    // station reloaded.
+    void on_recovered(InstanceCallback cb) { recovered_cb_ = std::move(cb); }
+    // Called when a play() has become audible, with its latency.
+    void on_switched(SwitchCallback cb) { switched_cb_ = std::move(cb); }
+    // Called right before an instance loads url, cold or into the standby.
+    void on_load(LoadCallback cb) { load_cb_ = std::move(cb); }
+
+private:
+    void wire(Player& mpv);
+    void switch_done(bool warm);
+    void load(Player& mpv, const std::string& url);
+
+    std::unique_ptr<Player> primary_;
+    std::unique_ptr<Player> secondary_;
+    Player* active_ = nullptr;
+    Player* standby_ = nullptr;
+    std::string standby_url_;
+    bool switch_pending_ = false;
+    std::string switch_url_;
+    std::chrono::steady_clock::time_point switch_start_;
+    int64_t last_switch_ms_ = -1;
+
+    InstanceCallback respawn_cb_;
+    InstanceCallback recovered_cb_;
+    SwitchCallback switched_cb_;
+    LoadCallback load_cb_;
+};
@@ -0,0 +1,262 @@
+#include "status_page.h"
+#include "log.h"
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <ctime>
+#include <new>
+
+namespace {
+
+constexpr uint32_t MAGIC = 0x52505352;   // "RPSR"
+constexpr uint32_t LAYOUT_VERSION = 1;
+
+} // namespace
+
+// Shared between processes: fixed size, no pointers. seq is odd while the
+// daemon is writing and is the futex word readers sleep on.
+struct StatusPage::Layout {
+    uint32_t magic;
+    uint32_t layout_version;
+    std::atomic<uint32_t> seq;
+    int32_t pid;
+    uint64_t version;
+    int32_t alive;
+    int32_t station_index;
+    int32_t station_count;
+    int32_t volume;
+    uint8_t playing;
+    uint8_t paused;
+    char station_name[128];
+    char station_url[512];
+    char metadata[256];
+};
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free,
+              "the sequence word must be usable across processes");
+
+static long futex(const std::atomic<uint32_t>* word, int op, uint32_t val,
+                  const struct timespec* timeout) {
+    return syscall(SYS_futex, reinterpret_cast<const uint32_t*>(word), op, val,
+                   timeout, nullptr, 0);
+}
+
+// Copies s into a fixed slot, never splitting a UTF-8 sequence.
+static void copy_str(char* dst, size_t cap, const std::string& s) {
+    size_t n = std::min(s.size(), cap - 1);
+    if (n < s.size()) {
+        while (n > 0 && (static_cast<unsigned char>(s[n]) & 0xC0) == 0x80) --n;
+    }
+    std::memcpy(dst, s.data(), n);
+    dst[n] = '\0';
+}
+
+static std::string slot_str(const char* src, size_t cap) {
+    return std::string(src, strnlen(src, cap));
+}
+
+bool StatusSnapshot::same_state(const StatusSnapshot& o) const {
+    return station_index == o.station_index && station_count == o.station_count &&
+           playing == o.playing && paused == o.paused && volume == o.volume &&
+           station_name == o.station_name && station_url == o.station_url &&
+           metadata == o.metadata;
+}
+
+nlohmann::json StatusSnapshot::to_json() const {
+    nlohmann::json state;
+    if (station_index > 0) {
+        state["station"] = {{"index", station_index},
+                            {"name", station_name},
+                            {"url", station_url}};
+    }
+    state["playing"] = playing;
+    state["paused"] = paused;
+    state["volume"] = volume;
+    state["metadata"] = metadata;
+    state["station_count"] = station_count;
+    return state;
+}
+
+StatusPage::~StatusPage() {
+    close();
+}
+
+bool StatusPage::create(const std::string& path) {
+    close();
+    // Build the new page under a temporary name and rename it into place:
+    // readers still mapping an old page keep their (dead) copy instead of
+    // seeing it truncated under them.
+    std::string tmp = path + ".tmp";
+    int fd = ::open(tmp.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        LOG_WARN("status page %s: %s", tmp.c_str(), strerror(errno));
+        return false;
+    }
+    if (ftruncate(fd, sizeof(Layout)) < 0) {
+        LOG_WARN("status page ftruncate: %s", strerror(errno));
+        ::close(fd);
+        unlink(tmp.c_str());
+        return false;
+    }
+    void* p = mmap(nullptr, sizeof(Layout), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) {
+        LOG_WARN("status page mmap: %s", strerror(errno));
+        unlink(tmp.c_str());
+        return false;
+    }
+    page_ = new (p) Layout{};
+    page_->magic = MAGIC;
+    page_->layout_version = LAYOUT_VERSION;
+    page_->pid = getpid();
+    page_->volume = -1;
+    if (rename(tmp.c_str(), path.c_str()) < 0) {
+        LOG_WARN("status page rename: %s", strerror(errno));
+        munmap(page_, sizeof(Layout));
+        page_ = nullptr;
+        unlink(tmp.c_str());
+        return false;
+    }
+    writer_ = true;
+    path_ = path;
+    last_ = StatusSnapshot{};
+    LOG_INFO("status page at %s", path.c_str());
+    return true;
+}
+
+bool StatusPage::open(const std::string& path) {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    struct stat st{};
+    if (fstat(fd, &st) < 0 || st.st_size < static_cast<off_t>(sizeof(Layout))) {
+        ::close(fd);
+        return false;
+    }
+    void* p = mmap(nullptr, sizeof(Layout), PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) return false;
+    page_ = static_cast<Layout*>(p);
+    if (page_->magic != MAGIC || page_->layout_version != LAYOUT_VERSION) {
+        munmap(page_, sizeof(Layout));
+        page_ = nullptr;
+        return false;
+    }
+    writer_ = false;
+    return true;
+}
+
+void StatusPage::close() {
+    if (!page_) return;
+    if (writer_) {
+        uint32_t s = page_->seq.load(std::memory_order_relaxed);
+        page_->seq.store(s + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        page_->alive = 0;
+        page_->seq.store(s + 2, std::memory_order_release);
+        futex(&page_->seq, FUTEX_WAKE, INT_MAX, nullptr);
+        unlink(path_.c_str());
+    }
+    munmap(page_, sizeof(Layout));
+    page_ = nullptr;
+    writer_ = false;
+    path_.clear();
+}
+
+void StatusPage::publish(const StatusSnapshot& s) {
+    if (!page_ || !writer_) return;
+    if (page_->alive && s.same_state(last_)) return;
+    last_ = s;
+    last_.version = page_->version + 1;
+
+    uint32_t seq = page_->seq.load(std::memory_order_relaxed);
+    page_->seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    page_->version = last_.version;
+    page_->alive = 1;
+    page_->station_index = s.station_index;
+    page_->station_count = s.station_count;
+    page_->volume = s.volume;
+    page_->playing = s.playing;
+    page_->paused = s.paused;
+    copy_str(page_->station_name, sizeof(page_->station_name), s.station_name);
+    copy_str(page_->station_url, sizeof(page_->station_url), s.station_url);
+    copy_str(page_->metadata, sizeof(page_->metadata), s.metadata);
+
+    page_->seq.store(seq + 2, std::memory_order_release);
+    futex(&page_->seq, FUTEX_WAKE, INT_MAX, nullptr);
+}
+
+bool StatusPage::read(StatusSnapshot& out) const {
+    if (!page_) return false;
+    Layout copy;
+    for (int tries = 0;; ++tries) {
+        uint32_t s1 = page_->seq.load(std::memory_order_acquire);
+        if (s1 & 1) {
+            // The daemon is mid-write; that takes well under a microsecond.
+            if (tries > 10000) return false;
+            continue;
+        }
+        std::memcpy(static_cast<void*>(&copy), page_, sizeof(Layout));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (page_->seq.load(std::memory_order_relaxed) == s1) break;
+    }
+    if (!copy.alive) return false;
+    // A daemon killed outright never marks its page dead.
+    if (kill(copy.pid, 0) < 0 && errno == ESRCH) return false;
+
+    out.version = copy.version;
+    out.station_index = copy.station_index;
+    out.station_count = copy.station_count;
+    out.volume = copy.volume;
+    out.playing = copy.playing;
+    out.paused = copy.paused;
+    out.station_name = slot_str(copy.station_name, sizeof(copy.station_name));
+    out.station_url = slot_str(copy.station_url, sizeof(copy.station_url));
+    out.metadata = slot_str(copy.metadata, sizeof(copy.metadata));
+    return true;
+}
+
+bool StatusPage::wait_change(uint64_t seen, int timeout_ms) const {
+    if (!page_) return false;
+    struct timespec deadline{};
+    if (timeout_ms >= 0) {
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_sec += timeout_ms / 1000;
+        deadline.tv_nsec += (timeout_ms % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            ++deadline.tv_sec;
+            deadline.tv_nsec -= 1000000000L;
+        }
+    }
+    while (true) {
+        uint32_t seq = page_->seq.load(std::memory_order_acquire);
+        StatusSnapshot now;
+        if (!read(now)) return false;
+        if (now.version != seen) return true;
+
+        struct timespec left{};
+        if (timeout_ms >= 0) {
+            struct timespec t{};
+            clock_gettime(CLOCK_MONOTONIC, &t);
+            int64_t ns = (deadline.tv_sec - t.tv_sec) * 1000000000LL +
+                         (deadline.tv_nsec - t.tv_nsec);
+            if (ns <= 0) return false;
+            left.tv_sec = ns / 1000000000LL;
+            left.tv_nsec = ns % 1000000000LL;
+        }
+        // Returns at once if seq moved since it was loaded, so no wake-up
+        // between the read above and this call is lost.
+        futex(&page_->seq, FUTEX_WAIT, seq, timeout_ms >= 0 ? &left : nullptr);
+    }
+}
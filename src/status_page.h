@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <nlohmann/json.hpp>
+
+// What `status` reports.
+struct StatusSnapshot {
+    uint64_t version = 0;        // bumped by every change the daemon publishes
+    int station_index = 0;       // 1-based, 0 if none selected
+    int station_count = 0;
+    std::string station_name;
+    std::string station_url;
+    bool playing = false;
+    bool paused = false;
+    int volume = -1;
+    std::string metadata;
+
+    bool same_state(const StatusSnapshot& o) const;
+    // Same shape as the IPC status command's data.
+    nlohmann::json to_json() const;
+};
+
+// The daemon's current state in a small shared file on tmpfs, so readers
+// need no round-trip through the daemon. The daemon writes it under a
+// seqlock; any number of processes map it read-only, read it without
+// locking, and can sleep on the sequence word (a futex) until it changes.
+// Strings longer than their slot are cut at a UTF-8 boundary.
+class StatusPage {
+public:
+    StatusPage() = default;
+    ~StatusPage();
+    StatusPage(const StatusPage&) = delete;
+    StatusPage& operator=(const StatusPage&) = delete;
+
+    // Writer: replaces any page at path with a fresh one.
+    bool create(const std::string& path);
+    // Reader: maps an existing page.
+    bool open(const std::string& path);
+    // Writer: marks the page dead and removes it; readers mapped from then
+    // on fall back to IPC.
+    void close();
+
+    // Writer: stores s unless it equals what is already there; the version
+    // is assigned here.
+    void publish(const StatusSnapshot& s);
+
+    // Reader: consistent copy of the page. False if the page was never
+    // written or its daemon is gone.
+    bool read(StatusSnapshot& out) const;
+    // Reader: sleeps until the version differs from seen (or timeout_ms
+    // passes; -1 waits forever). True if it changed.
+    bool wait_change(uint64_t seen, int timeout_ms) const;
+
+private:
+    struct Layout;
+
+    Layout* page_ = nullptr;
+    bool writer_ = false;
+    std::string path_;
+    StatusSnapshot last_;
+};